@@ -0,0 +1,4995 @@
+/**
+ * @file file_manager.hpp
+ * @author Harsh Raj
+ * @date 13 July, 2024
+ * @brief A dummy implementation of file manager,
+ * with a file storage in form of a n-ary tree like data structure.
+ * Header only, shared by the demo in main.cpp and the tools in tools/.
+ */
+
+#ifndef FILE_MANAGER_HPP
+#define FILE_MANAGER_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <exception>
+#include <memory>
+#include <cstdlib>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <type_traits>
+#include <utility>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <limits>
+#include <functional>
+
+class File;
+class Folder;
+class FileStorage;
+class FileManager;
+
+/**
+ * @class OutputSink
+ * @brief Buffered destination for everything the file manager prints.
+ * Text is collected in a large buffer and only handed to the underlying
+ * device when the buffer fills up or when flush() is called explicitly,
+ * so printing a huge listing costs a handful of writes instead of one per line.
+ */
+class OutputSink
+{
+private:
+    std::unique_ptr<char[]> buffer_;
+    std::size_t capacity_;
+    std::size_t used_;
+
+protected:
+    /**
+     * @brief hands data over to the underlying device
+     * @param buffered bytes collected in the buffer so far (may be empty)
+     * @param extra a large chunk that should follow the buffered bytes,
+     * passed separately so that it doesn't have to be copied into the buffer
+     */
+    virtual void drain(std::string_view buffered, std::string_view extra) noexcept = 0;
+
+    /**
+     * @brief makes the underlying device push out whatever it holds
+     */
+    virtual void sync() noexcept {}
+
+public:
+    static constexpr std::size_t kDefaultCapacity = 256 * 1024;
+
+    explicit OutputSink(std::size_t capacity = kDefaultCapacity) : buffer_{new char[capacity]}, capacity_{capacity}, used_{0} {}
+    OutputSink(const OutputSink &) = delete;
+    OutputSink &operator=(const OutputSink &) = delete;
+
+    /**
+     * @brief derived sinks must call flush() in their own destructor,
+     * the base class can't drain anymore once the derived part is gone
+     */
+    virtual ~OutputSink() = default;
+
+    void write(std::string_view text) noexcept
+    {
+        if (text.size() <= capacity_ - used_)
+        {
+            std::memcpy(buffer_.get() + used_, text.data(), text.size());
+            used_ += text.size();
+            return;
+        }
+        // chunks bigger than half the buffer go out directly behind the buffered bytes
+        if (text.size() >= capacity_ / 2)
+        {
+            drain({buffer_.get(), used_}, text);
+            used_ = 0;
+            return;
+        }
+        drain({buffer_.get(), used_}, {});
+        std::memcpy(buffer_.get(), text.data(), text.size());
+        used_ = text.size();
+    }
+
+    void put(char c) noexcept
+    {
+        if (used_ == capacity_)
+        {
+            drain({buffer_.get(), used_}, {});
+            used_ = 0;
+        }
+        buffer_[used_++] = c;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    void writeNumber(Integer value) noexcept
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        write({digits, static_cast<std::size_t>(result.ptr - digits)});
+    }
+
+    /**
+     * @brief explicit flush point, pushes everything buffered so far to the device
+     */
+    void flush() noexcept
+    {
+        if (used_ != 0)
+            drain({buffer_.get(), used_}, {});
+        used_ = 0;
+        sync();
+    }
+
+    OutputSink &operator<<(std::string_view text) noexcept
+    {
+        write(text);
+        return *this;
+    }
+
+    OutputSink &operator<<(const char *text) noexcept
+    {
+        write(text);
+        return *this;
+    }
+
+    OutputSink &operator<<(char c) noexcept
+    {
+        put(c);
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    OutputSink &operator<<(Integer value) noexcept
+    {
+        writeNumber(value);
+        return *this;
+    }
+
+    /**
+     * @brief gets the sink writing to the standard output,
+     * used by default by every FileManager object
+     */
+    static OutputSink &standardOutput();
+
+    /**
+     * @brief gets the sink writing to the standard error,
+     * used by default by every FileManager object for its error messages
+     */
+    static OutputSink &standardError();
+};
+
+/**
+ * @class OstreamOutputSink
+ * @brief OutputSink on top of a std::ostream
+ */
+class OstreamOutputSink : public OutputSink
+{
+private:
+    std::ostream &stream_;
+
+    void drain(std::string_view buffered, std::string_view extra) noexcept override
+    {
+        stream_.write(buffered.data(), buffered.size());
+        stream_.write(extra.data(), extra.size());
+    }
+
+    void sync() noexcept override
+    {
+        stream_.flush();
+    }
+
+public:
+    explicit OstreamOutputSink(std::ostream &stream, std::size_t capacity = kDefaultCapacity) : OutputSink{capacity}, stream_{stream} {}
+
+    ~OstreamOutputSink() noexcept override
+    {
+        flush();
+    }
+};
+
+/**
+ * @class FdOutputSink
+ * @brief OutputSink writing straight to a file descriptor,
+ * the buffered bytes and a large trailing chunk go out together with a single writev()
+ */
+class FdOutputSink : public OutputSink
+{
+private:
+    int fd_;
+    bool failed_;
+
+    void drain(std::string_view buffered, std::string_view extra) noexcept override
+    {
+        iovec parts[2] = {{const_cast<char *>(buffered.data()), buffered.size()},
+                          {const_cast<char *>(extra.data()), extra.size()}};
+        int first = 0;
+        while (failed_ == false && first < 2)
+        {
+            if (parts[first].iov_len == 0)
+            {
+                first++;
+                continue;
+            }
+            ssize_t written = ::writev(fd_, parts + first, 2 - first);
+            if (written < 0)
+            {
+                if (errno != EINTR)
+                    failed_ = true;
+                continue;
+            }
+            // skipping whatever the kernel took, partial writes are retried
+            std::size_t remaining = written;
+            while (first < 2 && remaining >= parts[first].iov_len)
+            {
+                remaining -= parts[first].iov_len;
+                first++;
+            }
+            if (first < 2)
+            {
+                parts[first].iov_base = static_cast<char *>(parts[first].iov_base) + remaining;
+                parts[first].iov_len -= remaining;
+            }
+        }
+    }
+
+public:
+    explicit FdOutputSink(int fd, std::size_t capacity = kDefaultCapacity) : OutputSink{capacity}, fd_{fd}, failed_{false} {}
+
+    ~FdOutputSink() noexcept override
+    {
+        flush();
+    }
+
+    /**
+     * @brief tells if a write to the file descriptor has failed,
+     * everything printed after a failure is dropped
+     */
+    bool failed() const noexcept
+    {
+        return failed_;
+    }
+};
+
+/**
+ * @class NullOutputSink
+ * @brief OutputSink that throws everything away, for measuring printing without a device
+ */
+class NullOutputSink : public OutputSink
+{
+private:
+    void drain(std::string_view, std::string_view) noexcept override {}
+
+public:
+    ~NullOutputSink() noexcept override
+    {
+        flush();
+    }
+};
+
+/**
+ * @class StringOutputSink
+ * @brief OutputSink collecting everything into a string, for checking what got printed
+ */
+class StringOutputSink : public OutputSink
+{
+private:
+    std::string text_;
+
+    void drain(std::string_view buffered, std::string_view extra) noexcept override
+    {
+        text_.append(buffered);
+        text_.append(extra);
+    }
+
+public:
+    explicit StringOutputSink(std::size_t capacity = 4096) : OutputSink{capacity} {}
+
+    ~StringOutputSink() noexcept override
+    {
+        flush();
+    }
+
+    /**
+     * @brief takes everything printed since the last call
+     */
+    std::string take()
+    {
+        flush();
+        return std::exchange(text_, {});
+    }
+};
+
+inline OutputSink &OutputSink::standardOutput()
+{
+    static OstreamOutputSink standardOutputSink{std::cout};
+    return standardOutputSink;
+}
+
+inline OutputSink &OutputSink::standardError()
+{
+    static OstreamOutputSink standardErrorSink{std::cerr};
+    return standardErrorSink;
+}
+
+/**
+ * @class JsonWriter
+ * @brief Streams JSON straight into an OutputSink without building a document in memory,
+ * the only state kept is one flag per currently open object or array
+ */
+class JsonWriter
+{
+private:
+    OutputSink &out_;
+    std::vector<bool> needsComma_;
+    bool afterKey_;
+
+    void separate() noexcept
+    {
+        if (afterKey_)
+        {
+            afterKey_ = false;
+            return;
+        }
+        if (needsComma_.empty() == false)
+        {
+            if (needsComma_.back())
+                out_.put(',');
+            needsComma_.back() = true;
+        }
+    }
+
+public:
+    explicit JsonWriter(OutputSink &out) : out_{out}, afterKey_{false} {}
+
+    /**
+     * @brief writes a quoted JSON string, runs of characters that don't need
+     * escaping are copied into the sink in one go
+     */
+    static void writeString(OutputSink &out, std::string_view text) noexcept
+    {
+        static constexpr char hexDigits[] = "0123456789abcdef";
+        out.put('"');
+        std::size_t runStart = 0;
+        for (std::size_t i = 0; i < text.size(); i++)
+        {
+            unsigned char c = text[i];
+            if (c >= 0x20 && c != '"' && c != '\\')
+                continue;
+            out.write(text.substr(runStart, i - runStart));
+            runStart = i + 1;
+            switch (c)
+            {
+            case '"':
+                out.write("\\\"");
+                break;
+            case '\\':
+                out.write("\\\\");
+                break;
+            case '\n':
+                out.write("\\n");
+                break;
+            case '\t':
+                out.write("\\t");
+                break;
+            case '\r':
+                out.write("\\r");
+                break;
+            default:
+                char escaped[] = {'\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF]};
+                out.write({escaped, sizeof(escaped)});
+            }
+        }
+        out.write(text.substr(runStart));
+        out.put('"');
+    }
+
+    JsonWriter &beginObject() noexcept
+    {
+        separate();
+        out_.put('{');
+        needsComma_.push_back(false);
+        return *this;
+    }
+
+    JsonWriter &endObject() noexcept
+    {
+        needsComma_.pop_back();
+        out_.put('}');
+        return *this;
+    }
+
+    JsonWriter &beginArray() noexcept
+    {
+        separate();
+        out_.put('[');
+        needsComma_.push_back(false);
+        return *this;
+    }
+
+    JsonWriter &endArray() noexcept
+    {
+        needsComma_.pop_back();
+        out_.put(']');
+        return *this;
+    }
+
+    JsonWriter &key(std::string_view name) noexcept
+    {
+        separate();
+        writeString(out_, name);
+        out_.put(':');
+        afterKey_ = true;
+        return *this;
+    }
+
+    JsonWriter &value(std::string_view text) noexcept
+    {
+        separate();
+        writeString(out_, text);
+        return *this;
+    }
+
+    JsonWriter &value(const char *text) noexcept
+    {
+        return value(std::string_view{text});
+    }
+
+    JsonWriter &value(double number) noexcept
+    {
+        separate();
+        char digits[32];
+        int length = std::snprintf(digits, sizeof(digits), "%.3f", number);
+        out_.write({digits, static_cast<std::size_t>(length)});
+        return *this;
+    }
+
+    JsonWriter &value(bool flag) noexcept
+    {
+        separate();
+        out_.write(flag ? "true" : "false");
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer>>>
+    JsonWriter &value(Integer number) noexcept
+    {
+        separate();
+        out_.writeNumber(number);
+        return *this;
+    }
+
+    template <typename Value>
+    JsonWriter &field(std::string_view name, Value &&fieldValue) noexcept
+    {
+        key(name);
+        return value(std::forward<Value>(fieldValue));
+    }
+};
+
+/**
+ * @enum Operation
+ * @brief FileManager operations whose latency gets recorded
+ */
+enum class Operation
+{
+    ChangeDirectory,
+    CreateFolder,
+    CreateFile,
+    UpdateFile,
+    DeleteFolder,
+    DeleteFile,
+    CreateFolders,
+    CreateFiles,
+    Count
+};
+
+constexpr std::size_t kOperationCount = static_cast<std::size_t>(Operation::Count);
+
+constexpr const char *operationName(Operation operation) noexcept
+{
+    constexpr const char *names[kOperationCount] = {"changeDirectory", "createFolder", "createFile",
+                                                    "updateFile", "deleteFolder", "deleteFile",
+                                                    "createFolders", "createFiles"};
+    return names[static_cast<std::size_t>(operation)];
+}
+
+/**
+ * @class LatencyHistogram
+ * @brief HDR style log-bucketed histogram of nanosecond latencies,
+ * values below 64 are exact and every power of two above that is split into 32 buckets
+ * (about 3% relative error), values are clamped to 2^40 ns (~18 minutes).
+ * Meant to be written by a single thread, other threads may read it any time.
+ */
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 6;
+    static constexpr int kMaxValueBits = 40;
+    static constexpr std::size_t kHalfSubBuckets = std::size_t{1} << (kSubBucketBits - 1);
+    static constexpr std::size_t kBucketCount = (kMaxValueBits - kSubBucketBits) * kHalfSubBuckets + 2 * kHalfSubBuckets;
+    static constexpr std::uint64_t kMaxValue = (std::uint64_t{1} << kMaxValueBits) - 1;
+
+    /**
+     * @brief maps a value to its bucket
+     */
+    static constexpr std::size_t bucketIndex(std::uint64_t value) noexcept
+    {
+        if (value > kMaxValue)
+            value = kMaxValue;
+        if (value < 2 * kHalfSubBuckets)
+            return value;
+        int exponent = 63 - __builtin_clzll(value);
+        int shift = exponent - kSubBucketBits + 1;
+        return shift * kHalfSubBuckets + (value >> shift);
+    }
+
+    /**
+     * @brief gets the highest value that maps to a bucket
+     */
+    static constexpr std::uint64_t bucketUpperBound(std::size_t index) noexcept
+    {
+        if (index < 2 * kHalfSubBuckets)
+            return index;
+        std::size_t shift = index / kHalfSubBuckets - 1;
+        std::uint64_t mantissa = index % kHalfSubBuckets + kHalfSubBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    /**
+     * @brief records a value, only the owning thread may call this;
+     * plain relaxed loads and stores are enough since nobody else writes
+     */
+    void record(std::uint64_t value) noexcept
+    {
+        std::atomic<std::uint64_t> &bucket = buckets_[bucketIndex(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed))
+            max_.store(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief clears the histogram, counts recorded while this runs may get lost
+     */
+    void reset() noexcept
+    {
+        for (auto &bucket : buckets_)
+            bucket.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @struct Snapshot
+     * @brief plain copy of one or more merged histograms, used for reporting
+     */
+    struct Snapshot
+    {
+        std::array<std::uint64_t, kBucketCount> counts{};
+        std::uint64_t totalCount = 0;
+        std::uint64_t sum = 0;
+        std::uint64_t max = 0;
+
+        void add(std::uint64_t value) noexcept
+        {
+            counts[bucketIndex(value)]++;
+            totalCount++;
+            sum += value;
+            if (value > max)
+                max = value;
+        }
+
+        void merge(const LatencyHistogram &histogram) noexcept
+        {
+            for (std::size_t i = 0; i < kBucketCount; i++)
+            {
+                std::uint64_t count = histogram.buckets_[i].load(std::memory_order_relaxed);
+                counts[i] += count;
+                totalCount += count;
+            }
+            sum += histogram.sum_.load(std::memory_order_relaxed);
+            std::uint64_t histogramMax = histogram.max_.load(std::memory_order_relaxed);
+            if (histogramMax > max)
+                max = histogramMax;
+        }
+
+        /**
+         * @brief gets the value below which a fraction of the recorded values fall
+         * @param quantile between 0 and 1, e.g. 0.99 for p99
+         * @return upper bound of the bucket holding the quantile, never more than max
+         */
+        std::uint64_t valueAt(double quantile) const noexcept
+        {
+            if (totalCount == 0)
+                return 0;
+            std::uint64_t rank = static_cast<std::uint64_t>(quantile * totalCount);
+            if (rank >= totalCount)
+                rank = totalCount - 1;
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < kBucketCount; i++)
+            {
+                seen += counts[i];
+                if (seen > rank)
+                    return bucketUpperBound(i) < max ? bucketUpperBound(i) : max;
+            }
+            return max;
+        }
+    };
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+    std::atomic<std::uint64_t> sum_{0};
+    std::atomic<std::uint64_t> max_{0};
+};
+
+/**
+ * @enum Counter
+ * @brief Event counters kept next to the latency histograms
+ */
+enum class Counter
+{
+    FoldersCreated,
+    FoldersDestroyed,
+    FilesCreated,
+    FilesDestroyed,
+    BytesWritten,
+    FolderNotFound,
+    FileNotFound,
+    FolderAlreadyExists,
+    FileAlreadyExists,
+    InvalidName,
+    InvalidPath,
+    LockContentions,
+    SearchSubtreesSkipped,
+    Count
+};
+
+constexpr std::size_t kCounterCount = static_cast<std::size_t>(Counter::Count);
+
+/**
+ * @class MetricsRegistry
+ * @brief Process wide operation counters and latency histograms.
+ * Each thread records into its own shard so recording is a couple of
+ * uncontended relaxed stores, shards are only merged when somebody reads them.
+ */
+class MetricsRegistry
+{
+private:
+    struct Shard
+    {
+        std::array<LatencyHistogram, kOperationCount> latencies;
+        std::array<LatencyHistogram, kOperationCount> lockWaits;
+        std::array<std::atomic<std::uint64_t>, kCounterCount> counters{};
+    };
+
+    mutable std::mutex shardsMutex_;
+    // shards are kept after their thread exits so that nothing recorded gets lost
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    MetricsRegistry() = default;
+
+    Shard &localShard()
+    {
+        thread_local Shard *shard = nullptr;
+        if (shard == nullptr)
+        {
+            std::lock_guard<std::mutex> lock{shardsMutex_};
+            shards_.push_back(std::make_unique<Shard>());
+            shard = shards_.back().get();
+        }
+        return *shard;
+    }
+
+    static void writeErrorMetric(OutputSink &out, const char *kind, std::uint64_t value)
+    {
+        out << "fm_errors_total{kind=\"" << kind << "\"} " << value << '\n';
+    }
+
+public:
+    MetricsRegistry(const MetricsRegistry &) = delete;
+    MetricsRegistry &operator=(const MetricsRegistry &) = delete;
+
+    static MetricsRegistry &instance()
+    {
+        static MetricsRegistry metricsRegistry;
+        return metricsRegistry;
+    }
+
+    void recordLatency(Operation operation, std::uint64_t nanoseconds)
+    {
+        localShard().latencies[static_cast<std::size_t>(operation)].record(nanoseconds);
+    }
+
+    /**
+     * @brief records how long an operation waited for the storage lock,
+     * 0 for acquisitions that didn't have to wait
+     */
+    void recordLockWait(Operation operation, std::uint64_t nanoseconds)
+    {
+        localShard().lockWaits[static_cast<std::size_t>(operation)].record(nanoseconds);
+    }
+
+    void increment(Counter counter, std::uint64_t by = 1)
+    {
+        std::atomic<std::uint64_t> &value = localShard().counters[static_cast<std::size_t>(counter)];
+        value.store(value.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief reads a counter of the calling thread only,
+     * cheap enough to take before/after deltas inside an operation
+     */
+    std::uint64_t localCounterValue(Counter counter)
+    {
+        return localShard().counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief sums a counter over every thread
+     */
+    std::uint64_t counterValue(Counter counter) const
+    {
+        std::uint64_t total = 0;
+        std::lock_guard<std::mutex> lock{shardsMutex_};
+        for (const auto &shard : shards_)
+            total += shard->counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    /**
+     * @brief merges the latencies of an operation from every thread
+     */
+    std::unique_ptr<LatencyHistogram::Snapshot> latencySnapshot(Operation operation) const
+    {
+        auto snapshot = std::make_unique<LatencyHistogram::Snapshot>();
+        std::lock_guard<std::mutex> lock{shardsMutex_};
+        for (const auto &shard : shards_)
+            snapshot->merge(shard->latencies[static_cast<std::size_t>(operation)]);
+        return snapshot;
+    }
+
+    /**
+     * @brief merges the storage lock waits of an operation from every thread
+     */
+    std::unique_ptr<LatencyHistogram::Snapshot> lockWaitSnapshot(Operation operation) const
+    {
+        auto snapshot = std::make_unique<LatencyHistogram::Snapshot>();
+        std::lock_guard<std::mutex> lock{shardsMutex_};
+        for (const auto &shard : shards_)
+            snapshot->merge(shard->lockWaits[static_cast<std::size_t>(operation)]);
+        return snapshot;
+    }
+
+    /**
+     * @brief prints count, p50, p99, p999 and max latency of every operation
+     */
+    void printLatencyReport(OutputSink &out) const
+    {
+        out << "Operation latencies (ns):\n";
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            auto snapshot = latencySnapshot(static_cast<Operation>(i));
+            out << operationName(static_cast<Operation>(i)) << ": ";
+            out << "count: " << snapshot->totalCount << ", ";
+            out << "p50: " << snapshot->valueAt(0.5) << ", ";
+            out << "p99: " << snapshot->valueAt(0.99) << ", ";
+            out << "p999: " << snapshot->valueAt(0.999) << ", ";
+            out << "max: " << snapshot->max << '\n';
+        }
+    }
+
+    /**
+     * @brief writes every metric in the Prometheus text exposition format
+     */
+    void writePrometheus(OutputSink &out) const
+    {
+        out << "# HELP fm_operation_latency_seconds Latency of FileManager operations.\n";
+        out << "# TYPE fm_operation_latency_seconds summary\n";
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            const char *name = operationName(static_cast<Operation>(i));
+            auto snapshot = latencySnapshot(static_cast<Operation>(i));
+            for (double quantile : {0.5, 0.99, 0.999})
+            {
+                char line[160];
+                int length = std::snprintf(line, sizeof(line), "fm_operation_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n",
+                                           name, quantile, snapshot->valueAt(quantile) / 1e9);
+                out.write({line, static_cast<std::size_t>(length)});
+            }
+            char line[160];
+            int length = std::snprintf(line, sizeof(line), "fm_operation_latency_seconds_sum{op=\"%s\"} %.9f\n", name, snapshot->sum / 1e9);
+            out.write({line, static_cast<std::size_t>(length)});
+            out << "fm_operation_latency_seconds_count{op=\"" << name << "\"} " << snapshot->totalCount << '\n';
+        }
+
+        out << "# HELP fm_lock_wait_seconds Time FileManager operations waited for the storage lock.\n";
+        out << "# TYPE fm_lock_wait_seconds summary\n";
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            const char *name = operationName(static_cast<Operation>(i));
+            auto snapshot = lockWaitSnapshot(static_cast<Operation>(i));
+            char line[160];
+            int length = std::snprintf(line, sizeof(line), "fm_lock_wait_seconds_sum{op=\"%s\"} %.9f\n", name, snapshot->sum / 1e9);
+            out.write({line, static_cast<std::size_t>(length)});
+            out << "fm_lock_wait_seconds_count{op=\"" << name << "\"} " << snapshot->totalCount << '\n';
+        }
+        out << "# HELP fm_lock_contentions_total Storage lock acquisitions that had to wait.\n";
+        out << "# TYPE fm_lock_contentions_total counter\n";
+        out << "fm_lock_contentions_total " << counterValue(Counter::LockContentions) << '\n';
+        out << "# HELP fm_search_subtrees_skipped_total Subtrees recursive searches skipped thanks to their name filters.\n";
+        out << "# TYPE fm_search_subtrees_skipped_total counter\n";
+        out << "fm_search_subtrees_skipped_total " << counterValue(Counter::SearchSubtreesSkipped) << '\n';
+
+        out << "# HELP fm_errors_total Failed FileManager operations by cause.\n";
+        out << "# TYPE fm_errors_total counter\n";
+        writeErrorMetric(out, "folder_not_found", counterValue(Counter::FolderNotFound));
+        writeErrorMetric(out, "file_not_found", counterValue(Counter::FileNotFound));
+        writeErrorMetric(out, "folder_already_exists", counterValue(Counter::FolderAlreadyExists));
+        writeErrorMetric(out, "file_already_exists", counterValue(Counter::FileAlreadyExists));
+        writeErrorMetric(out, "invalid_name", counterValue(Counter::InvalidName));
+        writeErrorMetric(out, "invalid_path", counterValue(Counter::InvalidPath));
+
+        out << "# HELP fm_bytes_written_total File content bytes written by createFile and updateFile.\n";
+        out << "# TYPE fm_bytes_written_total counter\n";
+        out << "fm_bytes_written_total " << counterValue(Counter::BytesWritten) << '\n';
+
+        std::uint64_t foldersCreated = counterValue(Counter::FoldersCreated);
+        std::uint64_t filesCreated = counterValue(Counter::FilesCreated);
+        out << "# HELP fm_nodes_created_total Folders and files created.\n";
+        out << "# TYPE fm_nodes_created_total counter\n";
+        out << "fm_nodes_created_total{type=\"folder\"} " << foldersCreated << '\n';
+        out << "fm_nodes_created_total{type=\"file\"} " << filesCreated << '\n';
+        out << "# HELP fm_nodes Folders and files currently alive.\n";
+        out << "# TYPE fm_nodes gauge\n";
+        out << "fm_nodes{type=\"folder\"} " << foldersCreated - counterValue(Counter::FoldersDestroyed) << '\n';
+        out << "fm_nodes{type=\"file\"} " << filesCreated - counterValue(Counter::FilesDestroyed) << '\n';
+    }
+
+    /**
+     * @brief writes the Prometheus exposition into a file,
+     * through a temporary file and a rename so scrapers never see half a dump
+     * @param filePath where to put the dump
+     * @throws std::runtime_error if the file can't be written
+     */
+    void dumpPrometheus(const std::string &filePath) const
+    {
+        std::string tempPath = filePath + ".tmp";
+        int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("Couldn't open metrics dump file");
+        bool failed;
+        {
+            FdOutputSink out{fd};
+            writePrometheus(out);
+            out.flush();
+            failed = out.failed();
+        }
+        ::close(fd);
+        if (failed || std::rename(tempPath.c_str(), filePath.c_str()) != 0)
+            throw std::runtime_error("Couldn't write metrics dump file");
+    }
+
+    /**
+     * @brief clears the latency and lock wait histograms, counters keep counting
+     * as Prometheus expects them to be monotonic
+     */
+    void resetLatencies()
+    {
+        std::lock_guard<std::mutex> lock{shardsMutex_};
+        for (const auto &shard : shards_)
+        {
+            for (auto &histogram : shard->latencies)
+                histogram.reset();
+            for (auto &histogram : shard->lockWaits)
+                histogram.reset();
+        }
+    }
+};
+
+/**
+ * @class MetricsEndpoint
+ * @brief Serves the Prometheus exposition on a local Unix socket,
+ * every client that connects gets one dump and is disconnected
+ */
+class MetricsEndpoint
+{
+private:
+    std::string socketPath_;
+    int listenFd_;
+    std::thread server_;
+
+    // a client that stops reading for this long gets dropped, so it can't hold up the server or its shutdown
+    static constexpr int kSendTimeoutMillis = 1000;
+
+    /**
+     * @brief sends all of text to a client, without raising SIGPIPE if it went away
+     * @return false if the client went away or stopped reading
+     */
+    static bool sendAll(int clientFd, std::string_view text) noexcept
+    {
+        while (text.empty() == false)
+        {
+            ssize_t sent = ::send(clientFd, text.data(), text.size(), MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            text.remove_prefix(static_cast<std::size_t>(sent));
+        }
+        return true;
+    }
+
+    void serve() noexcept
+    {
+        while (true)
+        {
+            int clientFd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (clientFd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                // the listening socket got shut down
+                return;
+            }
+            timeval timeout{kSendTimeoutMillis / 1000, (kSendTimeoutMillis % 1000) * 1000};
+            ::setsockopt(clientFd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            try
+            {
+                StringOutputSink dump;
+                MetricsRegistry::instance().writePrometheus(dump);
+                sendAll(clientFd, dump.take());
+            }
+            catch (const std::bad_alloc &)
+            {
+                // the client just gets nothing
+            }
+            ::close(clientFd);
+        }
+    }
+
+public:
+    /**
+     * @brief starts serving metrics in a background thread
+     * @param socketPath filesystem path of the Unix socket, replaced if it already exists
+     * @throws std::runtime_error if the socket can't be set up
+     */
+    explicit MetricsEndpoint(std::string socketPath) : socketPath_{std::move(socketPath)}, listenFd_{-1}
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (socketPath_.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("Metrics socket path is too long");
+        std::memcpy(address.sun_path, socketPath_.c_str(), socketPath_.size() + 1);
+
+        listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0)
+            throw std::runtime_error("Couldn't create metrics socket");
+        ::unlink(socketPath_.c_str());
+        if (::bind(listenFd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || ::listen(listenFd_, 16) != 0)
+        {
+            ::close(listenFd_);
+            throw std::runtime_error("Couldn't listen on metrics socket");
+        }
+        server_ = std::thread{&MetricsEndpoint::serve, this};
+    }
+
+    MetricsEndpoint(const MetricsEndpoint &) = delete;
+    MetricsEndpoint &operator=(const MetricsEndpoint &) = delete;
+
+    ~MetricsEndpoint() noexcept
+    {
+        // shutting the socket down wakes the server thread up from accept()
+        ::shutdown(listenFd_, SHUT_RDWR);
+        server_.join();
+        ::close(listenFd_);
+        ::unlink(socketPath_.c_str());
+    }
+};
+
+/**
+ * @brief FM_INSTRUMENTATION switches counters and latency timing on (1, the default) or off (0),
+ * build with -DFM_INSTRUMENTATION=0 to compile every recording site out of the hot paths
+ */
+#ifndef FM_INSTRUMENTATION
+#define FM_INSTRUMENTATION 1
+#endif
+
+/**
+ * @struct InstrumentationPolicy
+ * @brief Entry point of every recording site, when Enabled is false
+ * all of its functions are empty and vanish after inlining
+ */
+template <bool Enabled>
+struct InstrumentationPolicy
+{
+    static constexpr bool enabled = Enabled;
+
+    static void increment(Counter counter, std::uint64_t by = 1)
+    {
+        if constexpr (Enabled)
+            MetricsRegistry::instance().increment(counter, by);
+    }
+};
+
+using Instrumentation = InstrumentationPolicy<FM_INSTRUMENTATION != 0>;
+
+/**
+ * @enum Phase
+ * @brief Internal steps of FileManager operations that show up as nested trace spans
+ */
+enum class Phase
+{
+    SplitPath,
+    ResolvePath,
+    Allocate,
+    UpdateIndex,
+    WriteContent,
+    FreeNodes,
+    Count
+};
+
+constexpr std::size_t kPhaseCount = static_cast<std::size_t>(Phase::Count);
+
+constexpr const char *phaseName(Phase phase) noexcept
+{
+    constexpr const char *names[kPhaseCount] = {"splitPath", "resolvePath", "allocate",
+                                                "updateIndex", "writeContent", "freeNodes"};
+    return names[static_cast<std::size_t>(phase)];
+}
+
+inline std::uint64_t steadyNanoseconds() noexcept
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @class Tracer
+ * @brief Collects trace spans into a ring buffer per thread and exports them
+ * in the Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+ * Off until setEnabled(true), only the newest kRingCapacity spans of each thread are kept.
+ */
+class Tracer
+{
+private:
+    // a seqlock slot, sequence is odd while the owning thread writes it
+    // and 2 * (index + 1) once span number index is complete
+    struct Span
+    {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<const char *> category{nullptr};
+        std::atomic<std::uint64_t> start{0};
+        std::atomic<std::uint64_t> duration{0};
+    };
+
+    struct Ring
+    {
+        std::array<Span, 65536> spans;
+        // only the owning thread writes this
+        std::atomic<std::uint64_t> written{0};
+        // spans before this index were dropped by clear(), guarded by ringsMutex_
+        std::uint64_t cleared{0};
+        std::uint32_t threadId;
+    };
+
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<Ring>> rings_;
+
+    Tracer() = default;
+
+    Ring &localRing()
+    {
+        thread_local Ring *ring = nullptr;
+        if (ring == nullptr)
+        {
+            std::lock_guard<std::mutex> lock{ringsMutex_};
+            rings_.push_back(std::make_unique<Ring>());
+            ring = rings_.back().get();
+            ring->threadId = rings_.size();
+        }
+        return *ring;
+    }
+
+public:
+    static constexpr std::size_t kRingCapacity = std::tuple_size<decltype(Ring::spans)>::value;
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    static Tracer &instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    bool enabled() const noexcept
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) noexcept
+    {
+        enabled_.store(enabled, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief records a finished span on the calling thread's ring
+     * @param name must be a string literal (or live as long as the tracer)
+     */
+    void record(const char *name, const char *category, std::uint64_t start, std::uint64_t end)
+    {
+        Ring &ring = localRing();
+        std::uint64_t written = ring.written.load(std::memory_order_relaxed);
+        Span &span = ring.spans[written % kRingCapacity];
+        span.sequence.store(2 * written + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        span.name.store(name, std::memory_order_relaxed);
+        span.category.store(category, std::memory_order_relaxed);
+        span.start.store(start, std::memory_order_relaxed);
+        span.duration.store(end - start, std::memory_order_relaxed);
+        span.sequence.store(2 * written + 2, std::memory_order_release);
+        ring.written.store(written + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief writes every buffered span as Chrome trace JSON,
+     * spans overwritten while this runs are left out rather than written half updated
+     */
+    void writeChromeTrace(OutputSink &out) const
+    {
+        JsonWriter json{out};
+        json.beginObject().key("traceEvents").beginArray();
+        std::lock_guard<std::mutex> lock{ringsMutex_};
+        for (const auto &ring : rings_)
+        {
+            std::uint64_t written = ring->written.load(std::memory_order_acquire);
+            std::uint64_t first = written > kRingCapacity ? written - kRingCapacity : 0;
+            for (std::uint64_t i = std::max(first, ring->cleared); i < written; i++)
+            {
+                const Span &slot = ring->spans[i % kRingCapacity];
+                std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence != 2 * i + 2)
+                    continue;
+                const char *name = slot.name.load(std::memory_order_relaxed);
+                const char *category = slot.category.load(std::memory_order_relaxed);
+                std::uint64_t start = slot.start.load(std::memory_order_relaxed);
+                std::uint64_t duration = slot.duration.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+                    continue;
+                json.beginObject()
+                    .field("name", name)
+                    .field("cat", category)
+                    .field("ph", "X")
+                    .field("ts", start / 1000.0)
+                    .field("dur", duration / 1000.0)
+                    .field("pid", 1)
+                    .field("tid", ring->threadId)
+                    .endObject();
+            }
+        }
+        json.endArray().field("displayTimeUnit", "ns").endObject();
+        out.put('\n');
+    }
+
+    /**
+     * @brief drops every buffered span, rings keep counting so their owners are never written to
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock{ringsMutex_};
+        for (const auto &ring : rings_)
+            ring->cleared = ring->written.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * @class SlowOperationLog
+ * @brief Logs every operation slower than a threshold as one JSON line,
+ * with its working directory, argument, how much it touched and its phase timings.
+ * Operations only queue a record, formatting and writing happen on a background thread.
+ */
+class SlowOperationLog
+{
+public:
+    struct Record
+    {
+        Operation operation;
+        std::uint64_t duration;
+        std::uint64_t unixMilliseconds;
+        std::string workingDirectory;
+        std::string argument;
+        // how much the operation touched, content bytes for creates and updates, freed nodes for deletes
+        std::uint64_t touched;
+        bool hasTouched;
+        std::array<std::uint64_t, kPhaseCount> phaseDurations;
+    };
+
+    static constexpr std::size_t kMaxPendingRecords = 4096;
+
+private:
+    std::atomic<std::uint64_t> threshold_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+    std::mutex pendingMutex_;
+    std::condition_variable pendingChanged_;
+    std::deque<Record> pending_;
+    bool stopping_{false};
+    std::unique_ptr<OutputSink> out_;
+    std::thread writer_;
+
+    SlowOperationLog() = default;
+
+    void writeRecord(JsonWriter &json, const Record &record)
+    {
+        json.beginObject()
+            .field("op", operationName(record.operation))
+            .field("durationNs", record.duration)
+            .field("unixMs", record.unixMilliseconds)
+            .field("workingDirectory", record.workingDirectory)
+            .field("argument", record.argument);
+        if (record.hasTouched)
+            json.field(record.operation == Operation::DeleteFolder || record.operation == Operation::DeleteFile ? "nodesFreed" : "contentBytes",
+                       record.touched);
+        json.key("phasesNs").beginObject();
+        for (std::size_t i = 0; i < kPhaseCount; i++)
+        {
+            if (record.phaseDurations[i] != 0)
+                json.field(phaseName(static_cast<Phase>(i)), record.phaseDurations[i]);
+        }
+        json.endObject().endObject();
+        out_->put('\n');
+    }
+
+    void writeLoop()
+    {
+        std::deque<Record> batch;
+        std::unique_lock<std::mutex> lock{pendingMutex_};
+        while (true)
+        {
+            pendingChanged_.wait(lock, [this]
+                                 { return stopping_ || pending_.empty() == false; });
+            batch.swap(pending_);
+            bool stopping = stopping_;
+            lock.unlock();
+
+            JsonWriter json{*out_};
+            for (const Record &record : batch)
+                writeRecord(json, record);
+            std::uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+            if (dropped != 0)
+            {
+                json.beginObject().field("droppedRecords", dropped).endObject();
+                out_->put('\n');
+            }
+            out_->flush();
+            batch.clear();
+
+            lock.lock();
+            if (stopping && pending_.empty())
+                return;
+        }
+    }
+
+public:
+    SlowOperationLog(const SlowOperationLog &) = delete;
+    SlowOperationLog &operator=(const SlowOperationLog &) = delete;
+
+    static SlowOperationLog &instance()
+    {
+        static SlowOperationLog slowOperationLog;
+        return slowOperationLog;
+    }
+
+    /**
+     * @brief starts logging operations that take at least thresholdNanoseconds,
+     * replaces any earlier configuration
+     * @param out where the JSON lines go, owned by the log from now on
+     */
+    void enable(std::uint64_t thresholdNanoseconds, std::unique_ptr<OutputSink> out)
+    {
+        disable();
+        out_ = std::move(out);
+        stopping_ = false;
+        writer_ = std::thread{&SlowOperationLog::writeLoop, this};
+        threshold_.store(thresholdNanoseconds, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief stops logging, writes out everything still queued
+     */
+    void disable()
+    {
+        threshold_.store(0, std::memory_order_relaxed);
+        if (writer_.joinable() == false)
+            return;
+        {
+            std::lock_guard<std::mutex> lock{pendingMutex_};
+            stopping_ = true;
+        }
+        pendingChanged_.notify_one();
+        writer_.join();
+        out_.reset();
+    }
+
+    /**
+     * @brief gets the current threshold, 0 while the log is off
+     */
+    std::uint64_t threshold() const noexcept
+    {
+        return threshold_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief queues a record for the writer thread,
+     * records are dropped (and counted) instead of blocking if the writer falls behind
+     */
+    void submit(Record &&record)
+    {
+        {
+            std::lock_guard<std::mutex> lock{pendingMutex_};
+            if (pending_.size() >= kMaxPendingRecords)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            pending_.push_back(std::move(record));
+        }
+        pendingChanged_.notify_one();
+    }
+
+    ~SlowOperationLog()
+    {
+        disable();
+    }
+};
+
+/**
+ * @class BasicOperationTimer
+ * @brief Times the operation in whose scope it lives: records its latency,
+ * emits trace spans while tracing is on and hands it to the slow operation log
+ * when it took too long. Operations are split into consecutive phases with enter(),
+ * phases are only timed while tracing or the slow operation log is on.
+ */
+template <bool Enabled>
+class BasicOperationTimer
+{
+private:
+    Operation operation_;
+    std::uint64_t start_;
+    // the slow operation log threshold when the operation started, 0 while the log is off
+    std::uint64_t slowThreshold_;
+    // copied up front, the operation may move the file manager elsewhere before it ends
+    std::string workingDirectory_;
+    std::string_view argument_;
+    bool timePhases_;
+    bool hasTouched_;
+    Phase currentPhase_;
+    std::uint64_t phaseStart_;
+    std::uint64_t touched_;
+    std::array<std::uint64_t, kPhaseCount> phaseDurations_;
+
+    std::uint64_t destroyedNodes()
+    {
+        MetricsRegistry &metrics = MetricsRegistry::instance();
+        return metrics.localCounterValue(Counter::FoldersDestroyed) + metrics.localCounterValue(Counter::FilesDestroyed);
+    }
+
+    void finishPhase(std::uint64_t now)
+    {
+        if (currentPhase_ == Phase::Count)
+            return;
+        phaseDurations_[static_cast<std::size_t>(currentPhase_)] += now - phaseStart_;
+        if (Tracer::instance().enabled())
+            Tracer::instance().record(phaseName(currentPhase_), "phase", phaseStart_, now);
+    }
+
+public:
+    /**
+     * @param workingDirectory the directory the operation starts in, only copied while the slow operation log is on
+     * @param argument must outlive the timer, only copied for slow operations
+     */
+    BasicOperationTimer(Operation operation, const std::string &workingDirectory, std::string_view argument)
+        : operation_{operation}, start_{steadyNanoseconds()}, slowThreshold_{SlowOperationLog::instance().threshold()},
+          workingDirectory_{slowThreshold_ != 0 ? workingDirectory : std::string{}}, argument_{argument},
+          timePhases_{Tracer::instance().enabled() || slowThreshold_ != 0},
+          hasTouched_{false}, currentPhase_{Phase::Count}, phaseStart_{0}, touched_{0}, phaseDurations_{} {}
+    BasicOperationTimer(const BasicOperationTimer &) = delete;
+    BasicOperationTimer &operator=(const BasicOperationTimer &) = delete;
+
+    void enter(Phase phase)
+    {
+        if (timePhases_ == false)
+            return;
+        std::uint64_t now = steadyNanoseconds();
+        finishPhase(now);
+        currentPhase_ = phase;
+        phaseStart_ = now;
+    }
+
+    /**
+     * @brief notes how many content bytes the operation writes
+     */
+    void setContentBytes(std::uint64_t bytes) noexcept
+    {
+        touched_ = bytes;
+        hasTouched_ = true;
+    }
+
+    /**
+     * @brief starts counting the nodes this thread frees until the operation ends
+     */
+    void countFreedNodes()
+    {
+        if (slowThreshold_ == 0)
+            return;
+        touched_ = destroyedNodes();
+        hasTouched_ = true;
+    }
+
+    ~BasicOperationTimer()
+    {
+        std::uint64_t end = steadyNanoseconds();
+        std::uint64_t duration = end - start_;
+        MetricsRegistry::instance().recordLatency(operation_, duration);
+        if (timePhases_ == false)
+            return;
+        finishPhase(end);
+        if (Tracer::instance().enabled())
+            Tracer::instance().record(operationName(operation_), "operation", start_, end);
+
+        if (slowThreshold_ == 0 || duration < slowThreshold_)
+            return;
+        bool countsFreedNodes = operation_ == Operation::DeleteFolder || operation_ == Operation::DeleteFile;
+        SlowOperationLog::Record record{
+            operation_,
+            duration,
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count()),
+            std::move(workingDirectory_),
+            std::string{argument_.substr(0, 256)},
+            hasTouched_ && countsFreedNodes ? destroyedNodes() - touched_ : touched_,
+            hasTouched_,
+            phaseDurations_};
+        SlowOperationLog::instance().submit(std::move(record));
+    }
+};
+
+/**
+ * @brief disabled timer, doesn't read the clock and holds no state
+ */
+template <>
+class BasicOperationTimer<false>
+{
+public:
+    BasicOperationTimer(Operation, const std::string &, std::string_view) noexcept {}
+    BasicOperationTimer(const BasicOperationTimer &) = delete;
+    BasicOperationTimer &operator=(const BasicOperationTimer &) = delete;
+
+    void enter(Phase) noexcept {}
+    void setContentBytes(std::uint64_t) noexcept {}
+    void countFreedNodes() noexcept {}
+};
+
+using OperationTimer = BasicOperationTimer<Instrumentation::enabled>;
+
+/**
+ * @struct MemoryUsage
+ * @brief Estimated heap bytes by component of the storage,
+ * allocator bookkeeping and rounding aren't included
+ */
+struct MemoryUsage
+{
+    enum Category
+    {
+        Nodes,
+        ChildTables,
+        Names,
+        Paths,
+        Content,
+        Indexes,
+        Caches,
+        CategoryCount
+    };
+
+    std::array<std::int64_t, CategoryCount> bytes{};
+
+    static constexpr const char *categoryName(Category category) noexcept
+    {
+        constexpr const char *names[CategoryCount] = {"Nodes", "Child tables", "Names", "Paths", "Content", "Indexes", "Caches"};
+        return names[category];
+    }
+
+    /**
+     * @brief gets the heap bytes behind a string, 0 while it fits in the small string buffer
+     */
+    static std::int64_t stringBytes(const std::string &text) noexcept
+    {
+        const char *data = text.data();
+        const char *object = reinterpret_cast<const char *>(&text);
+        if (data >= object && data < object + sizeof(text))
+            return 0;
+        return text.capacity() + 1;
+    }
+
+    /**
+     * @brief gets the heap bytes of a copy of a string with the given length
+     */
+    static std::int64_t stringCopyBytes(std::size_t length) noexcept
+    {
+        static const std::size_t smallCapacity = std::string{}.capacity();
+        return length > smallCapacity ? length + 1 : 0;
+    }
+
+    /**
+     * @brief gets the bytes of a child table: its bucket array and one node per entry,
+     * not counting the heap bytes of the keys (those are Names)
+     */
+    template <typename Table>
+    static std::int64_t tableBytes(const Table &table) noexcept
+    {
+        // every node holds the next pointer, the entry and the cached hash
+        constexpr std::size_t nodeBytes = sizeof(void *) + sizeof(typename Table::value_type) + sizeof(std::size_t);
+        return table.bucket_count() * sizeof(void *) + table.size() * nodeBytes;
+    }
+
+    std::int64_t total() const noexcept
+    {
+        std::int64_t sum = 0;
+        for (std::int64_t categoryBytes : bytes)
+            sum += categoryBytes;
+        return sum;
+    }
+
+    MemoryUsage &operator+=(const MemoryUsage &other) noexcept
+    {
+        for (std::size_t i = 0; i < CategoryCount; i++)
+            bytes[i] += other.bytes[i];
+        return *this;
+    }
+
+    MemoryUsage &operator-=(const MemoryUsage &other) noexcept
+    {
+        for (std::size_t i = 0; i < CategoryCount; i++)
+            bytes[i] -= other.bytes[i];
+        return *this;
+    }
+
+    void print(OutputSink &out) const noexcept
+    {
+        for (std::size_t i = 0; i < CategoryCount; i++)
+            out << categoryName(static_cast<Category>(i)) << ": " << bytes[i] << ", ";
+        out << "Total: " << total() << '\n';
+    }
+};
+
+/**
+ * @class IncrementalHashTable
+ * @brief Chained hash table from names to children that grows without stopping the world:
+ * when it fills up it allocates a table twice the size and every later insert or erase moves
+ * one bucket over, while lookups check both tables. The move is done long before the new table
+ * fills up in turn, so no single operation pays for more than a bucket and a few empty slots.
+ * Const operations never move anything, so readers sharing a lock can use it at the same time.
+ */
+template <typename Node>
+class IncrementalHashTable
+{
+private:
+    struct Entry
+    {
+        Entry *next;
+        std::size_t hash;
+        std::string name;
+        Node *node;
+    };
+
+    struct FreeBuckets
+    {
+        void operator()(Entry **buckets) const noexcept
+        {
+            std::free(buckets);
+        }
+    };
+
+    struct Table
+    {
+        std::unique_ptr<Entry *[], FreeBuckets> buckets;
+        std::size_t bucketCount{0};
+        std::size_t size{0};
+        // no bucket below this one holds anything, so pop doesn't walk the same empty buckets again
+        std::size_t firstUsed{0};
+    };
+
+    static constexpr std::size_t kInitialBuckets = 4;
+    // empty buckets one step may walk past before it gives up for this time
+    static constexpr std::size_t kEmptyVisits = 10;
+    static constexpr std::size_t kNotRehashing = std::numeric_limits<std::size_t>::max();
+
+    // tables_[1] only exists while the entries move over from tables_[0]
+    Table tables_[2];
+    std::size_t rehashIndex_{kNotRehashing};
+
+    static std::size_t hashOf(const std::string &name) noexcept
+    {
+        return std::hash<std::string>{}(name);
+    }
+
+    /**
+     * @throws std::bad_alloc when the buckets can't be allocated
+     */
+    static Table makeTable(std::size_t bucketCount)
+    {
+        Table table;
+        // large zeroed arrays come as fresh pages from the kernel, so growing doesn't pay for clearing them
+        table.buckets.reset(static_cast<Entry **>(std::calloc(bucketCount, sizeof(Entry *))));
+        if (table.buckets == nullptr)
+            throw std::bad_alloc{};
+        table.bucketCount = bucketCount;
+        table.firstUsed = bucketCount;
+        return table;
+    }
+
+    bool rehashing() const noexcept
+    {
+        return rehashIndex_ != kNotRehashing;
+    }
+
+    Entry *findEntry(const std::string &name, std::size_t hash) const noexcept
+    {
+        for (std::size_t i = 0; i < (rehashing() ? 2 : 1); i++)
+        {
+            const Table &table = tables_[i];
+            if (table.bucketCount == 0)
+                continue;
+            for (Entry *entry = table.buckets[hash & (table.bucketCount - 1)]; entry != nullptr; entry = entry->next)
+            {
+                if (entry->hash == hash && entry->name == name)
+                    return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief starts moving into a table of bucketCount buckets, a table without buckets gets them right away
+     */
+    void grow(std::size_t bucketCount)
+    {
+        if (tables_[0].bucketCount == 0)
+        {
+            tables_[0] = makeTable(bucketCount);
+            return;
+        }
+        tables_[1] = makeTable(bucketCount);
+        rehashIndex_ = 0;
+        rehashStep();
+    }
+
+    /**
+     * @brief moves the next non-empty bucket to the new table, finishing the move when it was the last
+     */
+    void rehashStep() noexcept
+    {
+        if (rehashing() == false)
+            return;
+        Table &from = tables_[0];
+        Table &to = tables_[1];
+        for (std::size_t visits = 0; rehashIndex_ < from.bucketCount && from.buckets[rehashIndex_] == nullptr; visits++)
+        {
+            if (visits == kEmptyVisits)
+                return;
+            rehashIndex_++;
+        }
+        if (rehashIndex_ < from.bucketCount)
+        {
+            Entry *entry = from.buckets[rehashIndex_];
+            from.buckets[rehashIndex_++] = nullptr;
+            while (entry != nullptr)
+            {
+                Entry *next = entry->next;
+                std::size_t index = entry->hash & (to.bucketCount - 1);
+                entry->next = to.buckets[index];
+                to.buckets[index] = entry;
+                to.firstUsed = std::min(to.firstUsed, index);
+                from.size--;
+                to.size++;
+                entry = next;
+            }
+        }
+        if (from.size == 0)
+        {
+            tables_[0] = std::move(tables_[1]);
+            tables_[1] = Table{};
+            rehashIndex_ = kNotRehashing;
+        }
+    }
+
+    Entry *unlink(const std::string &name) noexcept
+    {
+        std::size_t hash = hashOf(name);
+        for (std::size_t i = 0; i < (rehashing() ? 2 : 1); i++)
+        {
+            Table &table = tables_[i];
+            if (table.bucketCount == 0)
+                continue;
+            for (Entry **link = &table.buckets[hash & (table.bucketCount - 1)]; *link != nullptr; link = &(*link)->next)
+            {
+                Entry *entry = *link;
+                if (entry->hash == hash && entry->name == name)
+                {
+                    *link = entry->next;
+                    table.size--;
+                    return entry;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    /**
+     * @class const_iterator
+     * @brief walks the old table and then the new one, yields the name in first and the child in second
+     */
+    class const_iterator
+    {
+    private:
+        friend class IncrementalHashTable;
+        const Table *tables_{nullptr};
+        std::size_t table_{0};
+        std::size_t bucket_{0};
+        const Entry *entry_{nullptr};
+
+        void skipEmpty() noexcept
+        {
+            while (entry_ == nullptr && table_ < 2)
+            {
+                if (bucket_ < tables_[table_].bucketCount)
+                    entry_ = tables_[table_].buckets[bucket_++];
+                else
+                {
+                    table_++;
+                    bucket_ = 0;
+                }
+            }
+        }
+
+    public:
+        const std::string &name() const noexcept
+        {
+            return entry_->name;
+        }
+
+        Node *node() const noexcept
+        {
+            return entry_->node;
+        }
+
+        const_iterator &operator++() noexcept
+        {
+            entry_ = entry_->next;
+            skipEmpty();
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const noexcept
+        {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const const_iterator &other) const noexcept
+        {
+            return entry_ != other.entry_;
+        }
+    };
+
+    IncrementalHashTable() = default;
+    IncrementalHashTable(const IncrementalHashTable &) = delete;
+    IncrementalHashTable &operator=(const IncrementalHashTable &) = delete;
+
+    ~IncrementalHashTable() noexcept
+    {
+        for (const Table &table : tables_)
+        {
+            for (std::size_t i = 0; i < table.bucketCount; i++)
+            {
+                for (Entry *entry = table.buckets[i]; entry != nullptr;)
+                {
+                    Entry *next = entry->next;
+                    delete entry;
+                    entry = next;
+                }
+            }
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return tables_[0].size + tables_[1].size;
+    }
+
+    std::size_t bucketCount() const noexcept
+    {
+        return tables_[0].bucketCount + tables_[1].bucketCount;
+    }
+
+    /**
+     * @brief finds the child called name
+     * @return the child, nullptr if there is none
+     */
+    Node *find(const std::string &name) const noexcept
+    {
+        Entry *entry = findEntry(name, hashOf(name));
+        return entry == nullptr ? nullptr : entry->node;
+    }
+
+    /**
+     * @brief replaces the child called name
+     * @return whether there was one to replace
+     */
+    bool assign(const std::string &name, Node *node) noexcept
+    {
+        Entry *entry = findEntry(name, hashOf(name));
+        if (entry == nullptr)
+            return false;
+        entry->node = node;
+        return true;
+    }
+
+    /**
+     * @brief adds a child, or replaces the child already called name
+     */
+    void insert(std::string name, Node *node)
+    {
+        rehashStep();
+        std::size_t hash = hashOf(name);
+        if (Entry *entry = findEntry(name, hash))
+        {
+            entry->node = node;
+            return;
+        }
+        if (rehashing() == false && size() >= tables_[0].bucketCount)
+            grow(tables_[0].bucketCount == 0 ? kInitialBuckets : 2 * tables_[0].bucketCount);
+        // while moving, new entries go straight to the new table
+        Table &table = tables_[rehashing() ? 1 : 0];
+        std::size_t index = hash & (table.bucketCount - 1);
+        table.buckets[index] = new Entry{table.buckets[index], hash, std::move(name), node};
+        table.firstUsed = std::min(table.firstUsed, index);
+        table.size++;
+    }
+
+    /**
+     * @brief removes the child called name
+     * @return the removed child, nullptr if there was none
+     */
+    Node *erase(const std::string &name) noexcept
+    {
+        rehashStep();
+        Entry *entry = unlink(name);
+        if (entry == nullptr)
+            return nullptr;
+        Node *node = entry->node;
+        delete entry;
+        return node;
+    }
+
+    /**
+     * @brief takes out any one entry, for moving the entries somewhere else a few at a time
+     * @return false when the table is empty
+     */
+    bool pop(std::string &name, Node *&node) noexcept
+    {
+        for (Table &table : tables_)
+        {
+            for (; table.firstUsed < table.bucketCount; table.firstUsed++)
+            {
+                Entry *entry = table.buckets[table.firstUsed];
+                if (entry == nullptr)
+                    continue;
+                table.buckets[table.firstUsed] = entry->next;
+                table.size--;
+                name = std::move(entry->name);
+                node = entry->node;
+                delete entry;
+                if (size() == 0)
+                {
+                    // the entries went somewhere else for good, the buckets can go too
+                    tables_[0] = Table{};
+                    tables_[1] = Table{};
+                    rehashIndex_ = kNotRehashing;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief starts growing so count entries fit, the entries move over during the next operations
+     */
+    void reserve(std::size_t count)
+    {
+        if (rehashing() || count <= tables_[0].bucketCount)
+            return;
+        std::size_t bucketCount = kInitialBuckets;
+        while (bucketCount < count)
+            bucketCount *= 2;
+        grow(bucketCount);
+    }
+
+    /**
+     * @brief gets the bytes of the bucket arrays and entries, not counting the heap bytes of the names
+     */
+    std::int64_t memoryBytes() const noexcept
+    {
+        return bucketCount() * sizeof(Entry *) + size() * sizeof(Entry);
+    }
+
+    const_iterator begin() const noexcept
+    {
+        const_iterator it;
+        it.tables_ = tables_;
+        it.skipEmpty();
+        return it;
+    }
+
+    const_iterator end() const noexcept
+    {
+        return {};
+    }
+};
+
+/**
+ * @brief FM_CHILD_INDEX_THRESHOLD is the number of entries past which a child table moves from
+ * a hash table to a B-tree, FM_BTREE_NODE_CAPACITY the number of entries a B-tree node holds.
+ * Build with small values (e.g. 2 and 3) to run the B-tree paths under the fuzzer.
+ */
+#ifndef FM_CHILD_INDEX_THRESHOLD
+#define FM_CHILD_INDEX_THRESHOLD 4096
+#endif
+#ifndef FM_BTREE_NODE_CAPACITY
+#define FM_BTREE_NODE_CAPACITY 64
+#endif
+
+/**
+ * @class ChildIndex
+ * @brief Child table of a folder, maps names to children. Small tables are an
+ * IncrementalHashTable, once a table grows past FM_CHILD_INDEX_THRESHOLD entries it moves to a
+ * B+ tree that grows one node split at a time and keeps the names in order for range scans.
+ * The move is spread out too: every later insert or erase takes a few entries over, lookups
+ * check both sides meanwhile. A tree that runs empty is dropped again.
+ * Keys only ever get move constructed or swapped, so each name keeps its heap buffer for
+ * the memory accounting.
+ */
+template <typename Node>
+class ChildIndex
+{
+public:
+    /**
+     * @brief what iterating yields, the name in first and the child in second like a map entry
+     */
+    struct Entry
+    {
+        const std::string &first;
+        Node *second;
+    };
+
+private:
+    using Table = IncrementalHashTable<Node>;
+    using Item = std::pair<std::string, Node *>;
+
+    static constexpr std::size_t kThreshold = FM_CHILD_INDEX_THRESHOLD;
+    // entries taken over from the table per operation, so the move is over in about 256 operations
+    static constexpr std::size_t kMoveStep = kThreshold / 256 + 1;
+    static constexpr std::size_t kCapacity = FM_BTREE_NODE_CAPACITY;
+    static_assert(kCapacity >= 3, "B-tree nodes have to hold at least 3 entries");
+
+    struct TreeNode
+    {
+        bool leaf;
+    };
+
+    struct Leaf : TreeNode
+    {
+        // sorted by name, the leaves form a list in name order
+        std::vector<Item> items;
+        Leaf *prev{nullptr};
+        Leaf *next{nullptr};
+
+        Leaf() : TreeNode{true}
+        {
+            items.reserve(kCapacity + 1);
+        }
+    };
+
+    struct Inner : TreeNode
+    {
+        // keys[i] separates children[i] from children[i + 1], every name in children[i + 1] is >= keys[i]
+        std::vector<std::string> keys;
+        std::vector<TreeNode *> children;
+
+        Inner() : TreeNode{false}
+        {
+            keys.reserve(kCapacity);
+            children.reserve(kCapacity + 1);
+        }
+    };
+
+    // the vectors are reserved up front so a node's size never changes
+    static constexpr std::int64_t kLeafBytes = sizeof(Leaf) + (kCapacity + 1) * sizeof(Item);
+    static constexpr std::int64_t kInnerBytes = sizeof(Inner) + kCapacity * sizeof(std::string) + (kCapacity + 1) * sizeof(TreeNode *);
+
+    Table table_;
+    // only there once the table went past the threshold
+    TreeNode *root_{nullptr};
+    std::size_t treeSize_{0};
+    std::int64_t treeBytes_{0};
+
+    static bool nameLess(const Item &item, const std::string &name) noexcept
+    {
+        return item.first < name;
+    }
+
+    /**
+     * @brief inserts value at index by appending it and swapping it down
+     */
+    template <typename T>
+    static void insertAt(std::vector<T> &values, std::size_t index, T value)
+    {
+        values.push_back(std::move(value));
+        for (std::size_t i = values.size() - 1; i > index; i--)
+            std::swap(values[i], values[i - 1]);
+    }
+
+    /**
+     * @brief removes the value at index by swapping it up to the end
+     */
+    template <typename T>
+    static void eraseAt(std::vector<T> &values, std::size_t index) noexcept
+    {
+        for (std::size_t i = index; i + 1 < values.size(); i++)
+            std::swap(values[i], values[i + 1]);
+        values.pop_back();
+    }
+
+    static std::size_t childIndex(const Inner &inner, const std::string &name) noexcept
+    {
+        return std::upper_bound(inner.keys.begin(), inner.keys.end(), name) - inner.keys.begin();
+    }
+
+    const Leaf *findLeaf(const std::string &name) const noexcept
+    {
+        const TreeNode *node = root_;
+        while (node->leaf == false)
+        {
+            const Inner *inner = static_cast<const Inner *>(node);
+            node = inner->children[childIndex(*inner, name)];
+        }
+        return static_cast<const Leaf *>(node);
+    }
+
+    const Leaf *firstLeaf() const noexcept
+    {
+        const TreeNode *node = root_;
+        while (node->leaf == false)
+            node = static_cast<const Inner *>(node)->children.front();
+        return static_cast<const Leaf *>(node);
+    }
+
+    /**
+     * @brief inserts into the subtree under node
+     * @return the new right sibling of node if node had to split, its first name goes to separator
+     */
+    TreeNode *insertInto(TreeNode *node, std::string &name, Node *child, std::string &separator)
+    {
+        if (node->leaf)
+        {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            auto position = std::lower_bound(leaf->items.begin(), leaf->items.end(), name, nameLess);
+            if (position != leaf->items.end() && position->first == name)
+            {
+                position->second = child;
+                return nullptr;
+            }
+            insertAt(leaf->items, position - leaf->items.begin(), Item{std::move(name), child});
+            treeSize_++;
+            if (leaf->items.size() <= kCapacity)
+                return nullptr;
+
+            Leaf *right = new Leaf;
+            std::size_t half = leaf->items.size() / 2;
+            for (std::size_t i = half; i < leaf->items.size(); i++)
+                right->items.push_back(std::move(leaf->items[i]));
+            leaf->items.erase(leaf->items.begin() + half, leaf->items.end());
+            right->next = leaf->next;
+            right->prev = leaf;
+            if (leaf->next != nullptr)
+                leaf->next->prev = right;
+            leaf->next = right;
+            separator = right->items.front().first;
+            treeBytes_ += kLeafBytes + MemoryUsage::stringBytes(separator);
+            return right;
+        }
+
+        Inner *inner = static_cast<Inner *>(node);
+        std::size_t index = childIndex(*inner, name);
+        std::string childSeparator;
+        TreeNode *newChild = insertInto(inner->children[index], name, child, childSeparator);
+        if (newChild == nullptr)
+            return nullptr;
+        insertAt(inner->keys, index, std::move(childSeparator));
+        insertAt(inner->children, index + 1, newChild);
+        if (inner->children.size() <= kCapacity)
+            return nullptr;
+
+        // the left half keeps children [0, half) and the key between the halves moves up
+        Inner *right = new Inner;
+        std::size_t half = inner->children.size() / 2;
+        separator = std::move(inner->keys[half - 1]);
+        for (std::size_t i = half; i < inner->keys.size(); i++)
+            right->keys.push_back(std::move(inner->keys[i]));
+        right->children.assign(inner->children.begin() + half, inner->children.end());
+        inner->keys.erase(inner->keys.begin() + (half - 1), inner->keys.end());
+        inner->children.erase(inner->children.begin() + half, inner->children.end());
+        treeBytes_ += kInnerBytes;
+        return right;
+    }
+
+    /**
+     * @brief removes name from the subtree under node, nodes that run empty get freed,
+     * underfull ones are left alone since merging wouldn't bound anything that matters here
+     * @return whether node ran empty and has to be removed by its parent
+     */
+    bool eraseFrom(TreeNode *node, const std::string &name, Node *&removed) noexcept
+    {
+        if (node->leaf)
+        {
+            Leaf *leaf = static_cast<Leaf *>(node);
+            auto position = std::lower_bound(leaf->items.begin(), leaf->items.end(), name, nameLess);
+            if (position == leaf->items.end() || position->first != name)
+                return false;
+            removed = position->second;
+            eraseAt(leaf->items, position - leaf->items.begin());
+            treeSize_--;
+            return leaf->items.empty();
+        }
+
+        Inner *inner = static_cast<Inner *>(node);
+        std::size_t index = childIndex(*inner, name);
+        TreeNode *child = inner->children[index];
+        if (eraseFrom(child, name, removed) == false)
+            return false;
+        if (child->leaf)
+        {
+            Leaf *leaf = static_cast<Leaf *>(child);
+            if (leaf->prev != nullptr)
+                leaf->prev->next = leaf->next;
+            if (leaf->next != nullptr)
+                leaf->next->prev = leaf->prev;
+        }
+        freeNode(child);
+        eraseAt(inner->children, index);
+        if (inner->keys.empty() == false)
+        {
+            std::size_t keyIndex = index == 0 ? 0 : index - 1;
+            treeBytes_ -= MemoryUsage::stringBytes(inner->keys[keyIndex]);
+            eraseAt(inner->keys, keyIndex);
+        }
+        return inner->children.empty();
+    }
+
+    /**
+     * @brief frees node without its children, they are gone or owned elsewhere by then
+     */
+    void freeNode(TreeNode *node) noexcept
+    {
+        if (node->leaf)
+        {
+            treeBytes_ -= kLeafBytes;
+            delete static_cast<Leaf *>(node);
+            return;
+        }
+        Inner *inner = static_cast<Inner *>(node);
+        for (const std::string &key : inner->keys)
+            treeBytes_ -= MemoryUsage::stringBytes(key);
+        treeBytes_ -= kInnerBytes;
+        delete inner;
+    }
+
+    void freeSubtree(TreeNode *node) noexcept
+    {
+        if (node->leaf == false)
+        {
+            for (TreeNode *child : static_cast<Inner *>(node)->children)
+                freeSubtree(child);
+        }
+        freeNode(node);
+    }
+
+    void startTree()
+    {
+        root_ = new Leaf;
+        treeBytes_ = kLeafBytes;
+        moveStep();
+    }
+
+    /**
+     * @brief takes the next few entries over from the table to the tree
+     */
+    void moveStep()
+    {
+        for (std::size_t i = 0; i < kMoveStep; i++)
+        {
+            std::string name;
+            Node *child;
+            if (table_.pop(name, child) == false)
+                return;
+            insertTree(std::move(name), child);
+        }
+    }
+
+    Node *findTree(const std::string &name) const noexcept
+    {
+        const Leaf *leaf = findLeaf(name);
+        auto position = std::lower_bound(leaf->items.begin(), leaf->items.end(), name, nameLess);
+        return position == leaf->items.end() || position->first != name ? nullptr : position->second;
+    }
+
+    Node *eraseTree(const std::string &name) noexcept
+    {
+        Node *removed = nullptr;
+        if (eraseFrom(root_, name, removed) && root_->leaf == false)
+        {
+            // the last entry is gone, an empty leaf stands in for the tree
+            freeNode(root_);
+            root_ = new Leaf;
+            treeBytes_ += kLeafBytes;
+        }
+        while (root_->leaf == false && static_cast<Inner *>(root_)->children.size() == 1)
+        {
+            TreeNode *onlyChild = static_cast<Inner *>(root_)->children.front();
+            freeNode(root_);
+            root_ = onlyChild;
+        }
+        return removed;
+    }
+
+    void insertTree(std::string name, Node *child)
+    {
+        std::string separator;
+        TreeNode *right = insertInto(root_, name, child, separator);
+        if (right == nullptr)
+            return;
+        Inner *root = new Inner;
+        root->keys.push_back(std::move(separator));
+        root->children.push_back(root_);
+        root->children.push_back(right);
+        root_ = root;
+        treeBytes_ += kInnerBytes;
+    }
+
+public:
+    /**
+     * @class const_iterator
+     * @brief walks the leaves of the tree in name order, then whatever is still in the table
+     */
+    class const_iterator
+    {
+    private:
+        friend class ChildIndex;
+        const Leaf *leaf_{nullptr};
+        std::size_t index_{0};
+        typename Table::const_iterator tableIt_;
+
+    public:
+        Entry operator*() const noexcept
+        {
+            if (leaf_ != nullptr)
+                return {leaf_->items[index_].first, leaf_->items[index_].second};
+            return {tableIt_.name(), tableIt_.node()};
+        }
+
+        const_iterator &operator++() noexcept
+        {
+            if (leaf_ == nullptr)
+                ++tableIt_;
+            else if (++index_ == leaf_->items.size())
+            {
+                leaf_ = leaf_->next;
+                index_ = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator &other) const noexcept
+        {
+            return leaf_ == other.leaf_ && index_ == other.index_ && tableIt_ == other.tableIt_;
+        }
+
+        bool operator!=(const const_iterator &other) const noexcept
+        {
+            return (*this == other) == false;
+        }
+    };
+
+    ChildIndex() = default;
+    ChildIndex(const ChildIndex &) = delete;
+    ChildIndex &operator=(const ChildIndex &) = delete;
+
+    ~ChildIndex() noexcept
+    {
+        if (root_ != nullptr)
+            freeSubtree(root_);
+    }
+
+    /**
+     * @brief whether every entry is in the tree, iteration is in name order then
+     */
+    bool ordered() const noexcept
+    {
+        return root_ != nullptr && table_.size() == 0;
+    }
+
+    std::size_t size() const noexcept
+    {
+        return treeSize_ + table_.size();
+    }
+
+    bool empty() const noexcept
+    {
+        return size() == 0;
+    }
+
+    /**
+     * @brief finds the child called name
+     * @return the child, nullptr if there is none
+     */
+    Node *find(const std::string &name) const noexcept
+    {
+        if (root_ != nullptr)
+        {
+            if (Node *child = findTree(name))
+                return child;
+        }
+        return table_.size() == 0 ? nullptr : table_.find(name);
+    }
+
+    std::size_t count(const std::string &name) const noexcept
+    {
+        return find(name) == nullptr ? 0 : 1;
+    }
+
+    /**
+     * @brief adds a child, or replaces the child already called name
+     */
+    void insert(std::string name, Node *child)
+    {
+        if (root_ == nullptr)
+        {
+            table_.insert(std::move(name), child);
+            if (table_.size() > kThreshold)
+                startTree();
+            return;
+        }
+        // a name that didn't move over yet gets replaced where it is
+        if (table_.size() == 0 || table_.assign(name, child) == false)
+            insertTree(std::move(name), child);
+        moveStep();
+    }
+
+    /**
+     * @brief removes the child called name
+     * @return the removed child, nullptr if there was none
+     */
+    Node *erase(const std::string &name)
+    {
+        if (root_ == nullptr)
+            return table_.erase(name);
+        Node *removed = table_.size() == 0 ? nullptr : table_.erase(name);
+        if (removed == nullptr)
+            removed = eraseTree(name);
+        moveStep();
+        if (treeSize_ == 0 && table_.size() == 0)
+        {
+            freeSubtree(root_);
+            root_ = nullptr;
+        }
+        return removed;
+    }
+
+    /**
+     * @brief makes room for count entries, a count past the threshold starts the tree right away
+     */
+    void reserve(std::size_t count)
+    {
+        if (root_ != nullptr)
+            return;
+        if (count > kThreshold)
+            startTree();
+        else
+            table_.reserve(count);
+    }
+
+    /**
+     * @brief calls visit(name, child) for every entry with from <= name < to in name order
+     * until it returns false, an empty to means no upper bound. The tree walks its leaves
+     * from from on, entries in the table get sorted and merged in.
+     */
+    template <typename Visit>
+    void scan(const std::string &from, const std::string &to, Visit &&visit) const
+    {
+        auto inRange = [&](const std::string &name)
+        { return name >= from && (to.empty() || name < to); };
+        std::vector<typename Table::const_iterator> pending;
+        for (auto entry = table_.begin(); entry != table_.end(); ++entry)
+        {
+            if (inRange(entry.name()))
+                pending.push_back(entry);
+        }
+        std::sort(pending.begin(), pending.end(), [](const auto &lhs, const auto &rhs)
+                  { return lhs.name() < rhs.name(); });
+        auto next = pending.begin();
+        bool going = true;
+        auto visitPendingBefore = [&](const std::string *bound)
+        {
+            for (; going && next != pending.end() && (bound == nullptr || next->name() < *bound); ++next)
+                going = visit(next->name(), next->node());
+        };
+
+        if (root_ != nullptr)
+        {
+            const Leaf *leaf = findLeaf(from);
+            std::size_t index = std::lower_bound(leaf->items.begin(), leaf->items.end(), from, nameLess) - leaf->items.begin();
+            for (; going && leaf != nullptr; leaf = leaf->next, index = 0)
+            {
+                for (; going && index < leaf->items.size() && inRange(leaf->items[index].first); index++)
+                {
+                    visitPendingBefore(&leaf->items[index].first);
+                    if (going)
+                        going = visit(leaf->items[index].first, leaf->items[index].second);
+                }
+                if (index < leaf->items.size())
+                    break;
+            }
+        }
+        visitPendingBefore(nullptr);
+    }
+
+    /**
+     * @brief gets the bytes of the table itself, not counting the heap bytes of the names
+     */
+    std::int64_t memoryBytes() const noexcept
+    {
+        return table_.memoryBytes() + treeBytes_;
+    }
+
+    const_iterator begin() const noexcept
+    {
+        const_iterator it;
+        it.tableIt_ = table_.begin();
+        if (root_ != nullptr && treeSize_ != 0)
+            it.leaf_ = firstLeaf();
+        return it;
+    }
+
+    const_iterator end() const noexcept
+    {
+        return {};
+    }
+};
+
+/**
+ * @enum ListingOrder
+ * @brief What sorted listings order files by, ties always go by name
+ */
+enum class ListingOrder
+{
+    Name,
+    Size,
+    ModifiedTime
+};
+
+/**
+ * @struct FileQuery
+ * @brief what FileManager::printMatchingFiles looks for, every bound is optional
+ */
+struct FileQuery
+{
+    std::size_t minSize = 0;
+    std::size_t maxSize = std::numeric_limits<std::size_t>::max();
+    // files modified at or after modifiedFrom and before modifiedBefore
+    std::chrono::system_clock::time_point modifiedFrom = std::chrono::system_clock::time_point::min();
+    std::chrono::system_clock::time_point modifiedBefore = std::chrono::system_clock::time_point::max();
+    // what the full paths have to start with
+    std::string pathPrefix;
+};
+
+class File
+{
+private:
+    friend class FileManager;
+    friend class Folder;
+    friend class FileStorage;
+
+    struct Metadata
+    {
+        std::size_t fileSize_;
+        std::string fullPath_;
+        std::string fileExtension_;
+        std::chrono::system_clock::time_point modifiedTime_;
+        Metadata(std::size_t size, std::string fullPath, std::string fileExtension) : fileSize_{size}, fullPath_{std::move(fullPath)}, fileExtension_{std::move(fileExtension)}, modifiedTime_{std::chrono::system_clock::now()} {}
+    };
+    Metadata metadata_;
+    std::string content_;
+
+    /**
+     * @struct LargerFirst
+     * @brief orders files by size, largest first, and files of the same size by path;
+     * a size on its own compares like a file of that size that comes before all of them
+     */
+    struct LargerFirst
+    {
+        using is_transparent = void;
+
+        bool operator()(const File *lhs, const File *rhs) const noexcept
+        {
+            if (lhs->metadata_.fileSize_ != rhs->metadata_.fileSize_)
+                return lhs->metadata_.fileSize_ > rhs->metadata_.fileSize_;
+            return lhs->metadata_.fullPath_ < rhs->metadata_.fullPath_;
+        }
+        bool operator()(const File *lhs, std::size_t size) const noexcept
+        {
+            return lhs->metadata_.fileSize_ > size;
+        }
+        bool operator()(std::size_t size, const File *rhs) const noexcept
+        {
+            return size >= rhs->metadata_.fileSize_;
+        }
+    };
+
+    /**
+     * @struct OlderFirst
+     * @brief orders files by modification time, oldest first, and files modified together by path;
+     * a time on its own compares like a file modified then that comes before all of them
+     */
+    struct OlderFirst
+    {
+        using is_transparent = void;
+        using TimePoint = std::chrono::system_clock::time_point;
+
+        bool operator()(const File *lhs, const File *rhs) const noexcept
+        {
+            if (lhs->metadata_.modifiedTime_ != rhs->metadata_.modifiedTime_)
+                return lhs->metadata_.modifiedTime_ < rhs->metadata_.modifiedTime_;
+            return lhs->metadata_.fullPath_ < rhs->metadata_.fullPath_;
+        }
+        bool operator()(const File *lhs, TimePoint time) const noexcept
+        {
+            return lhs->metadata_.modifiedTime_ < time;
+        }
+        bool operator()(TimePoint time, const File *rhs) const noexcept
+        {
+            return time <= rhs->metadata_.modifiedTime_;
+        }
+    };
+
+    // every file is in a node of each of the storage's size and modification time indexes,
+    // a red-black tree node (color, parent, left and right) holding the file pointer
+    static constexpr std::int64_t kIndexNodeBytes = 4 * sizeof(void *) + sizeof(File *);
+    static constexpr int kIndexCount = 2;
+
+    bool matches(const FileQuery &query) const noexcept
+    {
+        return metadata_.fileSize_ >= query.minSize && metadata_.fileSize_ <= query.maxSize &&
+               metadata_.modifiedTime_ >= query.modifiedFrom && metadata_.modifiedTime_ < query.modifiedBefore &&
+               metadata_.fullPath_.compare(0, query.pathPrefix.size(), query.pathPrefix) == 0;
+    }
+
+    File(std::string fullPath, std::string fileExtension, std::string content) : metadata_{content.size(), std::move(fullPath), std::move(fileExtension)}, content_{std::move(content)}
+    {
+        Instrumentation::increment(Counter::FilesCreated);
+        Instrumentation::increment(Counter::BytesWritten, content_.size());
+    }
+
+    /**
+     * @brief adds the memory held by this file to usage
+     */
+    void measureMemory(MemoryUsage &usage) const noexcept
+    {
+        usage.bytes[MemoryUsage::Nodes] += sizeof(File);
+        usage.bytes[MemoryUsage::Paths] += MemoryUsage::stringBytes(metadata_.fullPath_);
+        usage.bytes[MemoryUsage::Names] += MemoryUsage::stringBytes(metadata_.fileExtension_);
+        usage.bytes[MemoryUsage::Content] += MemoryUsage::stringBytes(content_);
+        usage.bytes[MemoryUsage::Indexes] += kIndexCount * kIndexNodeBytes;
+    }
+
+    void updateContent(const std::string newFileContent)
+    {
+        content_ = newFileContent;
+        metadata_.fileSize_ = newFileContent.size();
+        metadata_.modifiedTime_ = std::chrono::system_clock::now();
+        Instrumentation::increment(Counter::BytesWritten, content_.size());
+    }
+
+    void printContents(OutputSink &out) const noexcept
+    {
+        // Print metadata
+        out << "Metadata: ";
+        out << "Full Path: " << metadata_.fullPath_ << ", ";
+        out << "File Size: " << metadata_.fileSize_ << ", ";
+        out << "File Extension: " << metadata_.fileExtension_ << '\n';
+
+        // Print Contents
+        out << "Contents: " << content_ << '\n';
+    }
+
+    /**
+     * @brief writes this file as a JSON object
+     * @param name the name of this file in its parent folder
+     */
+    void writeJson(JsonWriter &json, std::string_view name) const noexcept
+    {
+        json.beginObject()
+            .field("type", "file")
+            .field("name", name)
+            .field("path", metadata_.fullPath_)
+            .field("size", metadata_.fileSize_)
+            .field("extension", metadata_.fileExtension_)
+            .endObject();
+    }
+
+public:
+    ~File() noexcept
+    {
+        Instrumentation::increment(Counter::FilesDestroyed);
+    }
+};
+
+/**
+ * @brief FM_NAME_FILTER_MIN_NAMES is the number of names a subtree needs before recursive searches
+ * build a name filter for it, smaller subtrees are cheaper to just walk.
+ * Build with 1 to give every folder a filter under the fuzzer.
+ */
+#ifndef FM_NAME_FILTER_MIN_NAMES
+#define FM_NAME_FILTER_MIN_NAMES 256
+#endif
+
+class Folder
+{
+private:
+    friend class FileManager;
+    friend class FileStorage;
+
+    struct Metadata
+    {
+        int foldersCount_;
+        int filesCount_;
+        std::string fullPath_;
+        Metadata(const int foldersCount, const int filesCount, std::string fullPath) : foldersCount_{foldersCount}, filesCount_{filesCount}, fullPath_{fullPath} {}
+    };
+    /**
+     * @struct CompletionList
+     * @brief the names of the children in order, for prefix completion,
+     * built by the first completion after a change and dropped by the next change
+     */
+    struct CompletionList
+    {
+        // the name and whether it is a folder's
+        std::vector<std::pair<const std::string *, bool>> names;
+
+        std::int64_t bytes() const noexcept
+        {
+            return sizeof(CompletionList) + names.capacity() * sizeof(names[0]);
+        }
+    };
+
+    /**
+     * @struct NameFilter
+     * @brief a counting Bloom filter of the names of everything under a folder, for recursive searches
+     * to skip subtrees that can't hold a name. Counters that saturate stay put, so a removal never
+     * turns a name that is still there into a miss.
+     */
+    struct NameFilter
+    {
+        static constexpr std::size_t kHashes = 4;
+        static constexpr std::size_t kCountersPerName = 8;
+        static constexpr std::uint8_t kSaturated = 255;
+
+        // past this many names false positives get too common and the filter is dropped
+        std::size_t capacity;
+        // a power of two in size
+        std::vector<std::uint8_t> counters;
+
+        explicit NameFilter(std::size_t capacity) : capacity{capacity}
+        {
+            std::size_t size = 64;
+            while (size < capacity * kCountersPerName)
+                size *= 2;
+            counters.assign(size, 0);
+        }
+
+        std::size_t slot(std::size_t hash, std::size_t i) const noexcept
+        {
+            // double hashing, the second hash is odd so the probes of a name differ
+            std::size_t step = static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull) >> 32) | 1;
+            return (hash + i * step) & (counters.size() - 1);
+        }
+
+        void add(std::size_t hash) noexcept
+        {
+            for (std::size_t i = 0; i < kHashes; i++)
+            {
+                std::uint8_t &counter = counters[slot(hash, i)];
+                counter += counter != kSaturated;
+            }
+        }
+
+        void remove(std::size_t hash) noexcept
+        {
+            for (std::size_t i = 0; i < kHashes; i++)
+            {
+                std::uint8_t &counter = counters[slot(hash, i)];
+                counter -= counter != kSaturated;
+            }
+        }
+
+        bool mayContain(std::size_t hash) const noexcept
+        {
+            for (std::size_t i = 0; i < kHashes; i++)
+            {
+                if (counters[slot(hash, i)] == 0)
+                    return false;
+            }
+            return true;
+        }
+
+        std::int64_t bytes() const noexcept
+        {
+            return sizeof(NameFilter) + counters.capacity();
+        }
+    };
+
+    Metadata metadata_;
+    Folder *parentFolder_;
+    ChildIndex<Folder> folders_;
+    ChildIndex<File> files_;
+    // readers holding the storage lock together may race to build it, see completionList
+    mutable std::atomic<const CompletionList *> completions_{nullptr};
+    // the number of folders and files under this folder, kept up to date along the parent chain
+    std::size_t subtreeNames_ = 0;
+    // built by the first search reaching this folder, see mayHoldName
+    mutable std::atomic<NameFilter *> nameFilter_{nullptr};
+    // the id of every extension in this folder and below with its number of files, in id order
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> extensionCounts_;
+
+    Folder(const std::string fullPath, Folder *parentFolder) : metadata_{0, 0, fullPath}, parentFolder_{parentFolder}
+    {
+        if (parentFolder != nullptr)
+            folders_.insert("..", parentFolder);
+        Instrumentation::increment(Counter::FoldersCreated);
+    }
+
+    void addFolder(std::string newFolderName, Folder *newFolderPointer) noexcept
+    {
+        dropCompletions();
+        folders_.insert(std::move(newFolderName), newFolderPointer);
+        metadata_.foldersCount_++;
+    }
+
+    void addFile(std::string newFileName, File *newFilePointer) noexcept
+    {
+        dropCompletions();
+        files_.insert(std::move(newFileName), newFilePointer);
+        metadata_.filesCount_++;
+    }
+
+    /**
+     * @brief makes room for count more child folders, that may move the names around
+     * (to a B-tree) so the completion list goes
+     */
+    void reserveFolders(std::size_t count)
+    {
+        dropCompletions();
+        folders_.reserve(folders_.size() + count);
+    }
+
+    /**
+     * @brief makes room for count more files, see reserveFolders
+     */
+    void reserveFiles(std::size_t count)
+    {
+        dropCompletions();
+        files_.reserve(files_.size() + count);
+    }
+
+    /**
+     * @brief gets the sorted names for completion, building them if a change dropped them.
+     * Readers sharing the storage lock may build at the same time, the first one to publish
+     * its list wins and the others throw theirs away.
+     * @param built set to the bytes of the list if this call published it, for the caller to account
+     */
+    const CompletionList &completionList(std::int64_t &built) const
+    {
+        built = 0;
+        if (const CompletionList *list = completions_.load(std::memory_order_acquire))
+            return *list;
+        auto list = std::make_unique<CompletionList>();
+        list->names.reserve(folders_.size() + files_.size());
+        for (const auto &curFolder : folders_)
+        {
+            if (curFolder.first != "..")
+                list->names.push_back({&curFolder.first, true});
+        }
+        for (const auto &curFile : files_)
+            list->names.push_back({&curFile.first, false});
+        // a folder and a file may share a name, the folder goes first
+        std::sort(list->names.begin(), list->names.end(), [](const auto &lhs, const auto &rhs)
+                  {
+                      int order = lhs.first->compare(*rhs.first);
+                      return order != 0 ? order < 0 : lhs.second && rhs.second == false; });
+        const CompletionList *published = nullptr;
+        if (completions_.compare_exchange_strong(published, list.get(), std::memory_order_acq_rel, std::memory_order_acquire) == false)
+            return *published;
+        built = list->bytes();
+        return *list.release();
+    }
+
+    /**
+     * @brief gets the bytes of the completion list, 0 while there is none
+     */
+    std::int64_t completionBytes() const noexcept
+    {
+        const CompletionList *list = completions_.load(std::memory_order_acquire);
+        return list == nullptr ? 0 : list->bytes();
+    }
+
+    /**
+     * @brief drops the completion list, only while holding the storage lock alone
+     */
+    void dropCompletions() noexcept
+    {
+        delete completions_.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    static std::size_t nameHash(const std::string &name) noexcept
+    {
+        return std::hash<std::string>{}(name);
+    }
+
+    /**
+     * @brief checks whether a folder or file named name may be under this folder, building the name
+     * filter if there is none yet. Small subtrees get no filter and always may hold the name.
+     * Readers sharing the storage lock may build at the same time, like with completionList.
+     * @param hash the nameHash of the name
+     * @param built increased by the bytes of the filter if this call published it, for the caller to account
+     */
+    bool mayHoldName(std::size_t hash, std::int64_t &built) const
+    {
+        if (subtreeNames_ < FM_NAME_FILTER_MIN_NAMES)
+            return subtreeNames_ != 0;
+        if (const NameFilter *filter = nameFilter_.load(std::memory_order_acquire))
+            return filter->mayContain(hash);
+        // room to grow before changes below fill it up
+        auto filter = std::make_unique<NameFilter>(subtreeNames_ * 2);
+        forEachSubtreeName([&](const std::string &name)
+                           { filter->add(nameHash(name)); });
+        NameFilter *published = nullptr;
+        if (nameFilter_.compare_exchange_strong(published, filter.get(), std::memory_order_acq_rel, std::memory_order_acquire) == false)
+            return published->mayContain(hash);
+        built += filter->bytes();
+        return filter.release()->mayContain(hash);
+    }
+
+    /**
+     * @brief calls visit with the name of every folder and file under this folder
+     */
+    template <typename Visit>
+    void forEachSubtreeName(Visit visit) const
+    {
+        std::vector<const Folder *> pending{this};
+        while (pending.empty() == false)
+        {
+            const Folder *folder = pending.back();
+            pending.pop_back();
+            for (const auto &curFile : folder->files_)
+                visit(curFile.first);
+            for (const auto &curFolder : folder->folders_)
+            {
+                if (curFolder.first == "..")
+                    continue;
+                visit(curFolder.first);
+                pending.push_back(curFolder.second);
+            }
+        }
+    }
+
+    /**
+     * @brief calls visit with every file under this folder
+     */
+    template <typename Visit>
+    void forEachSubtreeFile(Visit visit) const
+    {
+        std::vector<const Folder *> pending{this};
+        while (pending.empty() == false)
+        {
+            const Folder *folder = pending.back();
+            pending.pop_back();
+            for (const auto &curFile : folder->files_)
+                visit(curFile.second);
+            for (const auto &curFolder : folder->folders_)
+            {
+                if (curFolder.first != "..")
+                    pending.push_back(curFolder.second);
+            }
+        }
+    }
+
+    /**
+     * @brief records a folder or file named with hash added right below this folder in the name counts
+     * and filters of this folder and its ancestors, only while holding the storage lock alone.
+     * Filters that fill up are dropped for the next search to build them again at a bigger size.
+     * @param delta decreased by the bytes of the dropped filters
+     */
+    void noteNameAdded(std::size_t hash, MemoryUsage &delta) noexcept
+    {
+        for (Folder *folder = this; folder != nullptr; folder = folder->parentFolder_)
+        {
+            folder->subtreeNames_++;
+            NameFilter *filter = folder->nameFilter_.load(std::memory_order_relaxed);
+            if (filter == nullptr)
+                continue;
+            if (folder->subtreeNames_ <= filter->capacity)
+                filter->add(hash);
+            else
+            {
+                delta.bytes[MemoryUsage::Indexes] -= filter->bytes();
+                folder->dropNameFilter();
+            }
+        }
+    }
+
+    /**
+     * @brief records folders and files removed from right below this folder, see noteNameAdded
+     * @param hashes the nameHash of every name that went, the subtree of a folder included
+     */
+    void noteNamesRemoved(const std::vector<std::size_t> &hashes) noexcept
+    {
+        for (Folder *folder = this; folder != nullptr; folder = folder->parentFolder_)
+        {
+            folder->subtreeNames_ -= hashes.size();
+            if (NameFilter *filter = folder->nameFilter_.load(std::memory_order_relaxed))
+            {
+                for (std::size_t hash : hashes)
+                    filter->remove(hash);
+            }
+        }
+    }
+
+    /**
+     * @brief gets the number of files with an extension in this folder and below
+     * @param id the extension's id from FileStorage::findExtension
+     */
+    std::uint32_t filesWithExtension(std::uint32_t id) const noexcept
+    {
+        auto found = std::lower_bound(extensionCounts_.begin(), extensionCounts_.end(), std::make_pair(id, std::uint32_t{0}));
+        return found == extensionCounts_.end() || found->first != id ? 0 : found->second;
+    }
+
+    /**
+     * @brief records a file with an extension added right below this folder in the extension counts
+     * of this folder and its ancestors
+     * @param delta increased by the bytes the counts grow by
+     */
+    void noteExtensionAdded(std::uint32_t id, MemoryUsage &delta)
+    {
+        for (Folder *folder = this; folder != nullptr; folder = folder->parentFolder_)
+        {
+            auto &counts = folder->extensionCounts_;
+            auto found = std::lower_bound(counts.begin(), counts.end(), std::make_pair(id, std::uint32_t{0}));
+            if (found != counts.end() && found->first == id)
+            {
+                found->second++;
+                continue;
+            }
+            delta.bytes[MemoryUsage::Indexes] -= folder->extensionCountsBytes();
+            counts.insert(found, {id, 1});
+            delta.bytes[MemoryUsage::Indexes] += folder->extensionCountsBytes();
+        }
+    }
+
+    /**
+     * @brief records files removed from right below this folder, see noteExtensionAdded
+     * @param removed the number of files that went by extension id, in id order
+     * @param freed increased by the bytes the counts shrink by
+     */
+    void noteExtensionsRemoved(const std::vector<std::pair<std::uint32_t, std::uint32_t>> &removed, MemoryUsage &freed) noexcept
+    {
+        for (Folder *folder = this; folder != nullptr; folder = folder->parentFolder_)
+        {
+            auto &counts = folder->extensionCounts_;
+            auto count = counts.begin();
+            for (const auto &[id, files] : removed)
+            {
+                count = std::lower_bound(count, counts.end(), std::make_pair(id, std::uint32_t{0}));
+                count->second -= files;
+            }
+            counts.erase(std::remove_if(counts.begin(), counts.end(), [](const auto &entry)
+                                        { return entry.second == 0; }),
+                         counts.end());
+            // give the memory back once most extensions are gone
+            if (counts.size() < counts.capacity() / 4)
+            {
+                freed.bytes[MemoryUsage::Indexes] += folder->extensionCountsBytes();
+                counts.shrink_to_fit();
+                freed.bytes[MemoryUsage::Indexes] -= folder->extensionCountsBytes();
+            }
+        }
+    }
+
+    std::int64_t extensionCountsBytes() const noexcept
+    {
+        return extensionCounts_.capacity() * sizeof(extensionCounts_[0]);
+    }
+
+    /**
+     * @brief gets the bytes of the name filter, 0 while there is none
+     */
+    std::int64_t nameFilterBytes() const noexcept
+    {
+        const NameFilter *filter = nameFilter_.load(std::memory_order_acquire);
+        return filter == nullptr ? 0 : filter->bytes();
+    }
+
+    /**
+     * @brief drops the name filter, only while holding the storage lock alone
+     */
+    void dropNameFilter() noexcept
+    {
+        delete nameFilter_.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    /**
+     * @brief adds the memory held by this folder itself to usage,
+     * i.e. its node, path, child tables and child names but not the children
+     */
+    void measureOwnMemory(MemoryUsage &usage) const noexcept
+    {
+        usage.bytes[MemoryUsage::Nodes] += sizeof(Folder);
+        usage.bytes[MemoryUsage::Paths] += MemoryUsage::stringBytes(metadata_.fullPath_);
+        usage.bytes[MemoryUsage::ChildTables] += childTablesBytes();
+        usage.bytes[MemoryUsage::Caches] += completionBytes();
+        usage.bytes[MemoryUsage::Indexes] += nameFilterBytes() + extensionCountsBytes();
+        for (const auto &curFolder : folders_)
+            usage.bytes[MemoryUsage::Names] += MemoryUsage::stringBytes(curFolder.first);
+        for (const auto &curFile : files_)
+            usage.bytes[MemoryUsage::Names] += MemoryUsage::stringBytes(curFile.first);
+    }
+
+    /**
+     * @brief adds the memory held by this folder and everything under it to usage
+     */
+    void measureSubtreeMemory(MemoryUsage &usage) const noexcept
+    {
+        std::vector<const Folder *> pending{this};
+        while (pending.empty() == false)
+        {
+            const Folder *folder = pending.back();
+            pending.pop_back();
+            folder->measureOwnMemory(usage);
+            for (const auto &curFile : folder->files_)
+                curFile.second->measureMemory(usage);
+            for (const auto &curFolder : folder->folders_)
+            {
+                if (curFolder.first != "..")
+                    pending.push_back(curFolder.second);
+            }
+        }
+    }
+
+    std::int64_t childTablesBytes() const noexcept
+    {
+        return folders_.memoryBytes() + files_.memoryBytes();
+    }
+
+    void removeFolder(const std::string folderName) noexcept
+    {
+        dropCompletions();
+        delete folders_.erase(folderName);
+        metadata_.foldersCount_--;
+    }
+
+    void removeFile(const std::string fileName) noexcept
+    {
+        dropCompletions();
+        delete files_.erase(fileName);
+        metadata_.filesCount_--;
+    }
+
+    void printContents(OutputSink &out) const noexcept
+    {
+        // Print metadata
+        out << "Metadata: ";
+        out << "Full Path: " << metadata_.fullPath_ << ", ";
+        out << "No. of folders: " << metadata_.foldersCount_ << ", ";
+        out << "No. of files: " << metadata_.filesCount_ << '\n';
+
+        // Print folders
+        out << "Folders: ";
+        for (const auto &curFolder : folders_)
+            out << curFolder.first << ", ";
+        out << '\n';
+
+        // Print files
+        out << "Files: ";
+        for (const auto &curFiles : files_)
+            out << curFiles.first << ", ";
+        out << '\n';
+    }
+
+    /**
+     * @brief prints the child folders and files whose names are in [from, to) in name order,
+     * an empty to means no upper bound and ".." is left out since it isn't a child
+     */
+    void printRange(OutputSink &out, const std::string &from, const std::string &to) const
+    {
+        out << "Folders: ";
+        folders_.scan(from, to, [&out](const std::string &name, const Folder *)
+                      {
+                          if (name != "..")
+                              out << name << ", ";
+                          return true; });
+        out << '\n';
+
+        out << "Files: ";
+        files_.scan(from, to, [&out](const std::string &name, const File *)
+                    {
+                        out << name << ", ";
+                        return true; });
+        out << '\n';
+    }
+
+    /**
+     * @brief picks the first limit children in the order of less without sorting the others,
+     * a heap holds the best ones so far with the worst on top, so it costs n log(limit)
+     */
+    template <typename Node, typename Less>
+    static std::vector<std::pair<const std::string *, Node *>> selectFirst(const ChildIndex<Node> &children, std::size_t limit, Less less)
+    {
+        std::vector<std::pair<const std::string *, Node *>> heap;
+        if (limit == 0)
+            return heap;
+        heap.reserve(std::min(limit, children.size()));
+        for (const auto &child : children)
+        {
+            if (child.first == "..")
+                continue;
+            std::pair<const std::string *, Node *> candidate{&child.first, child.second};
+            if (heap.size() < limit)
+            {
+                heap.push_back(candidate);
+                std::push_heap(heap.begin(), heap.end(), less);
+            }
+            else if (less(candidate, heap.front()))
+            {
+                std::pop_heap(heap.begin(), heap.end(), less);
+                heap.back() = candidate;
+                std::push_heap(heap.begin(), heap.end(), less);
+            }
+        }
+        std::sort_heap(heap.begin(), heap.end(), less);
+        return heap;
+    }
+
+    /**
+     * @brief picks the first limit children by name, walking the names in order where the
+     * child table keeps them and selecting from all of them otherwise
+     */
+    template <typename Node>
+    static std::vector<std::pair<const std::string *, Node *>> firstByName(const ChildIndex<Node> &children, std::size_t limit, bool descending)
+    {
+        using Entry = std::pair<const std::string *, Node *>;
+        if (descending || children.ordered() == false)
+        {
+            return selectFirst(children, limit, [descending](const Entry &lhs, const Entry &rhs)
+                               { return descending ? *rhs.first < *lhs.first : *lhs.first < *rhs.first; });
+        }
+        std::vector<Entry> first;
+        if (limit == 0)
+            return first;
+        children.scan("", "", [&](const std::string &name, Node *child)
+                      {
+                          if (name != "..")
+                              first.push_back({&name, child});
+                          return first.size() < limit; });
+        return first;
+    }
+
+    /**
+     * @brief prints a page of at most limit children in the given order, only the children that
+     * make the page ever get sorted. By name folders come first, folders have neither a size nor
+     * a modification time so the other orders list files only.
+     * @param descending whether the order is reversed, e.g. to get the largest files first
+     */
+    void printPage(OutputSink &out, ListingOrder order, std::size_t limit, bool descending) const
+    {
+        out << "Folders: ";
+        std::vector<std::pair<const std::string *, Folder *>> folders;
+        if (order == ListingOrder::Name)
+            folders = firstByName(folders_, limit, descending);
+        for (const auto &folder : folders)
+            out << *folder.first << ", ";
+        out << '\n';
+
+        limit -= folders.size();
+        std::vector<std::pair<const std::string *, File *>> files;
+        auto byKey = [descending](auto key)
+        {
+            return [descending, key](const std::pair<const std::string *, File *> &lhs, const std::pair<const std::string *, File *> &rhs)
+            {
+                auto lhsKey = key(*lhs.second);
+                auto rhsKey = key(*rhs.second);
+                if (lhsKey != rhsKey)
+                    return descending ? rhsKey < lhsKey : lhsKey < rhsKey;
+                return *lhs.first < *rhs.first;
+            };
+        };
+        if (order == ListingOrder::Name)
+            files = firstByName(files_, limit, descending);
+        else if (order == ListingOrder::Size)
+            files = selectFirst(files_, limit, byKey([](const File &file)
+                                                     { return file.metadata_.fileSize_; }));
+        else
+            files = selectFirst(files_, limit, byKey([](const File &file)
+                                                     { return file.metadata_.modifiedTime_; }));
+        out << "Files: ";
+        for (const auto &file : files)
+            out << *file.first << ", ";
+        out << '\n';
+    }
+
+    void writeJsonHeader(JsonWriter &json, std::string_view name) const noexcept
+    {
+        json.beginObject()
+            .field("type", "folder")
+            .field("name", name)
+            .field("path", metadata_.fullPath_)
+            .field("folders", metadata_.foldersCount_)
+            .field("files", metadata_.filesCount_);
+    }
+
+    /**
+     * @brief writes this folder as a JSON object with its children nested in "children"
+     * @param name the name of this folder in its parent folder
+     * @param recursive whether child folders list their own children too,
+     * the subtree is walked with an explicit stack so memory only grows with the depth
+     */
+    void writeJson(JsonWriter &json, std::string_view name, bool recursive) const noexcept
+    {
+        struct Frame
+        {
+            const Folder *folder;
+            ChildIndex<Folder>::const_iterator nextFolder;
+        };
+        std::vector<Frame> stack;
+
+        writeJsonHeader(json, name);
+        json.key("children").beginArray();
+        stack.push_back({this, folders_.begin()});
+        while (stack.empty() == false)
+        {
+            Frame &top = stack.back();
+            while (top.nextFolder != top.folder->folders_.end() && (*top.nextFolder).first == "..")
+                ++top.nextFolder;
+            if (top.nextFolder != top.folder->folders_.end())
+            {
+                const Folder *child = (*top.nextFolder).second;
+                child->writeJsonHeader(json, (*top.nextFolder).first);
+                ++top.nextFolder;
+                json.key("children").beginArray();
+                if (recursive)
+                {
+                    stack.push_back({child, child->folders_.begin()});
+                    continue;
+                }
+                json.endArray().endObject();
+                continue;
+            }
+            // all child folders done, files go last
+            for (const auto &curFile : top.folder->files_)
+                curFile.second->writeJson(json, curFile.first);
+            json.endArray().endObject();
+            stack.pop_back();
+        }
+    }
+
+    void writeNdjsonLine(JsonWriter &json, OutputSink &out) const noexcept
+    {
+        json.beginObject()
+            .field("type", "folder")
+            .field("path", metadata_.fullPath_)
+            .field("folders", metadata_.foldersCount_)
+            .field("files", metadata_.filesCount_)
+            .endObject();
+        out.put('\n');
+    }
+
+    /**
+     * @brief writes this folder and its children as newline delimited JSON,
+     * one object per line and without nesting
+     * @param recursive whether the whole subtree is written or just the direct children
+     */
+    void writeNdjson(OutputSink &out, bool recursive) const noexcept
+    {
+        // top level values don't get separated, so one writer serves every line
+        JsonWriter json{out};
+        std::vector<const Folder *> pending{this};
+        while (pending.empty() == false)
+        {
+            const Folder *folder = pending.back();
+            pending.pop_back();
+            folder->writeNdjsonLine(json, out);
+            for (const auto &curFile : folder->files_)
+            {
+                curFile.second->writeJson(json, curFile.first);
+                out.put('\n');
+            }
+            for (const auto &curFolder : folder->folders_)
+            {
+                if (curFolder.first == "..")
+                    continue;
+                if (recursive)
+                    pending.push_back(curFolder.second);
+                else
+                    curFolder.second->writeNdjsonLine(json, out);
+            }
+        }
+    }
+
+public:
+    ~Folder() noexcept
+    {
+        // deleting all child folders too
+        for (auto curFolder : folders_)
+        {
+            if (curFolder.first == "..")
+                continue;
+            delete curFolder.second;
+        }
+        // deleting all child files too
+        for (auto curFile : files_)
+        {
+            delete curFile.second;
+        }
+        dropCompletions();
+        dropNameFilter();
+        Instrumentation::increment(Counter::FoldersDestroyed);
+    }
+};
+
+/**
+ * @class FileStorage
+ * @brief Simulates a n-ary tree like file storage,
+ * think of this like a file partition or a disc on your computer.
+ * Several FileManager objects on different threads can work on one storage at the same time.
+ */
+class FileStorage
+{
+private:
+    Folder *rootFolder;
+    // where the storage announces its own deletion
+    OutputSink *outputSink_;
+    MemoryUsage memoryUsage_;
+    // caches and search filters get built by readers under the shared lock, so what they add is counted apart
+    std::array<std::atomic<std::int64_t>, MemoryUsage::CategoryCount> lazyBytes_{};
+    // one lock for the whole tree: readers share it, anything that changes the tree takes it alone
+    mutable std::shared_mutex mutex_;
+    // bumped by every folder deletion, guarded by mutex_
+    std::uint64_t folderGeneration_;
+    // every file extension seen so far and its id, ids are never reused so folders can keep counts by id.
+    // Only grows under the lock held alone; a few bytes per distinct extension, not counted in memoryUsage_
+    std::unordered_map<std::string, std::uint32_t> extensionIds_;
+    // every file, largest first and oldest first; their nodes are counted in File::measureMemory
+    std::set<const File *, File::LargerFirst> filesBySize_;
+    std::set<const File *, File::OlderFirst> filesByTime_;
+
+    template <typename Lock>
+    Lock acquire(Operation operation) const
+    {
+        // the uncontended path doesn't touch the clock
+        Lock lock{mutex_, std::try_to_lock};
+        if (lock.owns_lock())
+        {
+            if constexpr (Instrumentation::enabled)
+                MetricsRegistry::instance().recordLockWait(operation, 0);
+            return lock;
+        }
+        if constexpr (Instrumentation::enabled)
+        {
+            std::uint64_t start = steadyNanoseconds();
+            lock.lock();
+            MetricsRegistry::instance().recordLockWait(operation, steadyNanoseconds() - start);
+            MetricsRegistry::instance().increment(Counter::LockContentions);
+        }
+        else
+            lock.lock();
+        return lock;
+    }
+
+public:
+    /**
+     * @param outputSink where the storage announces its deletion, it must outlive the storage
+     */
+    explicit FileStorage(OutputSink *outputSink = &OutputSink::standardOutput()) : outputSink_{outputSink}, folderGeneration_{0}
+    {
+        // Initialize a root folder for this storage here, this value will be used by FileManager objects
+        rootFolder = new Folder("/", nullptr);
+        rootFolder->measureOwnMemory(memoryUsage_);
+    }
+
+    /**
+     * @brief gets the memory held by the whole storage, kept up to date
+     * by FileManager objects as they change the tree
+     */
+    MemoryUsage getMemoryUsage() const noexcept
+    {
+        MemoryUsage usage = memoryUsage_;
+        for (std::size_t category = 0; category < MemoryUsage::CategoryCount; category++)
+            usage.bytes[category] += lazyBytes_[category].load(std::memory_order_relaxed);
+        return usage;
+    }
+
+    /**
+     * @brief records memory that got allocated (or freed, if negative) in the storage
+     */
+    void accountMemory(const MemoryUsage &delta) noexcept
+    {
+        memoryUsage_ += delta;
+    }
+
+    /**
+     * @brief records a cache or filter built while holding the storage lock shared
+     */
+    void accountLazyMemory(MemoryUsage::Category category, std::int64_t bytes) noexcept
+    {
+        lazyBytes_[category].fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief gets the id of a file extension, giving it the next one if it's new;
+     * only while holding the storage lock alone
+     */
+    std::uint32_t internExtension(const std::string &extension)
+    {
+        return extensionIds_.try_emplace(extension, static_cast<std::uint32_t>(extensionIds_.size())).first->second;
+    }
+
+    /**
+     * @brief looks up the id of a file extension
+     * @return false if no file ever had that extension
+     */
+    bool findExtension(const std::string &extension, std::uint32_t &id) const noexcept
+    {
+        auto found = extensionIds_.find(extension);
+        if (found == extensionIds_.end())
+            return false;
+        id = found->second;
+        return true;
+    }
+
+    /**
+     * @brief adds a file to the size and modification time indexes, only while holding
+     * the storage lock alone and before its size or modification time change again
+     */
+    void indexFile(const File *file)
+    {
+        filesBySize_.insert(file);
+        filesByTime_.insert(file);
+    }
+
+    /**
+     * @brief removes a file from the indexes, before its size or modification time change or it gets deleted
+     */
+    void unindexFile(const File *file) noexcept
+    {
+        filesBySize_.erase(file);
+        filesByTime_.erase(file);
+    }
+
+    /**
+     * @brief gets the files matching a query. The size range and the modification time range are
+     * walked in step until one of them ends, that one is the smaller and its files get checked
+     * against the rest of the query, so the cost is twice the smaller range.
+     */
+    std::vector<const File *> findFiles(const FileQuery &query) const
+    {
+        std::vector<const File *> found;
+        if (query.minSize > query.maxSize || query.modifiedFrom >= query.modifiedBefore)
+            return found;
+        auto bySizeBegin = filesBySize_.lower_bound(query.maxSize);
+        // the first file smaller than minSize
+        auto bySizeEnd = query.minSize == 0 ? filesBySize_.end() : filesBySize_.lower_bound(query.minSize - 1);
+        auto byTimeBegin = filesByTime_.lower_bound(query.modifiedFrom);
+        auto byTimeEnd = filesByTime_.lower_bound(query.modifiedBefore);
+        auto bySize = bySizeBegin;
+        auto byTime = byTimeBegin;
+        while (bySize != bySizeEnd && byTime != byTimeEnd)
+        {
+            ++bySize;
+            ++byTime;
+        }
+        auto collect = [&](auto begin, auto end)
+        {
+            for (; begin != end; ++begin)
+            {
+                if ((*begin)->matches(query))
+                    found.push_back(*begin);
+            }
+        };
+        if (bySize == bySizeEnd)
+            collect(bySizeBegin, bySizeEnd);
+        else
+            collect(byTimeBegin, byTimeEnd);
+        return found;
+    }
+
+    /**
+     * @brief gets every file in the storage, largest first
+     */
+    const std::set<const File *, File::LargerFirst> &getFilesBySize() const noexcept
+    {
+        return filesBySize_;
+    }
+
+    /**
+     * @brief gets the number of folder deletions so far, FileManager objects compare it
+     * with the value they saw last to find out if their current folder may be gone
+     */
+    std::uint64_t getFolderGeneration() const noexcept
+    {
+        return folderGeneration_;
+    }
+
+    /**
+     * @brief records that a folder got deleted
+     */
+    void noteFolderDeleted() noexcept
+    {
+        folderGeneration_++;
+    }
+
+    /**
+     * @brief locks the storage for an operation that only reads the tree,
+     * any number of readers hold it together
+     * @param operation the operation to account the wait to
+     */
+    std::shared_lock<std::shared_mutex> lockShared(Operation operation) const
+    {
+        return acquire<std::shared_lock<std::shared_mutex>>(operation);
+    }
+
+    /**
+     * @brief locks the storage for an operation that changes the tree
+     * @param operation the operation to account the wait to
+     */
+    std::unique_lock<std::shared_mutex> lockExclusive(Operation operation) const
+    {
+        return acquire<std::unique_lock<std::shared_mutex>>(operation);
+    }
+
+    /**
+     * @brief locks the storage for a read that isn't one of the timed operations (printing, exports),
+     * the wait isn't recorded
+     */
+    std::shared_lock<std::shared_mutex> lockShared() const
+    {
+        return std::shared_lock<std::shared_mutex>{mutex_};
+    }
+
+    /**
+     * @brief gets the root folder pointer
+     * @return pointer to the root folder of type Folder *
+     */
+    Folder *getRootFolder() const
+    {
+        return rootFolder;
+    }
+
+    /**
+     * @brief deletes the whole tree that we created as the storage,
+     * including all the childeren too by calling destructor of the root folder
+     */
+    ~FileStorage() noexcept
+    {
+        delete rootFolder;
+        OutputSink &out = *outputSink_;
+        out << "\n=====\n"
+            << "Storage Deleted" << '\n';
+        out.flush();
+    }
+};
+
+/**
+ * @struct TraceEntry
+ * @brief One FileManager call of an operation trace
+ */
+struct TraceEntry
+{
+    std::uint64_t offsetMicros;
+    Operation operation;
+    std::string argument;
+    // 1 for relative and 0 for absolute changeDirectory calls, content size for createFile and updateFile
+    std::uint64_t detail;
+};
+
+/**
+ * @class OperationRecorder
+ * @brief Writes every operation of a FileManager as one line of a replayable trace:
+ * microseconds since the recorder started, operation, argument and detail separated by tabs,
+ * with tabs, newlines and backslashes in the argument escaped by a backslash
+ */
+class OperationRecorder
+{
+private:
+    OutputSink &out_;
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    explicit OperationRecorder(OutputSink &out) : out_{out}, start_{std::chrono::steady_clock::now()} {}
+
+    static void writeEntry(OutputSink &out, const TraceEntry &entry) noexcept
+    {
+        out << entry.offsetMicros << '\t' << operationName(entry.operation) << '\t';
+        for (char c : entry.argument)
+        {
+            if (c == '\t')
+                out << "\\t";
+            else if (c == '\n')
+                out << "\\n";
+            else if (c == '\\')
+                out << "\\\\";
+            else
+                out.put(c);
+        }
+        out << '\t' << entry.detail << '\n';
+    }
+
+    /**
+     * @brief parses one line written by writeEntry()
+     * @throws std::runtime_error if the line is malformed
+     */
+    static TraceEntry parseEntry(std::string_view line)
+    {
+        std::string_view fields[4];
+        std::size_t start = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            std::size_t end = i == 3 ? line.size() : line.find('\t', start);
+            if (end == std::string_view::npos)
+                throw std::runtime_error("Trace line needs 4 tab separated fields");
+            fields[i] = line.substr(start, end - start);
+            start = end + 1;
+        }
+
+        TraceEntry entry{0, Operation::Count, "", 0};
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            if (fields[1] == operationName(static_cast<Operation>(i)))
+                entry.operation = static_cast<Operation>(i);
+        }
+        if (entry.operation == Operation::Count)
+            throw std::runtime_error("Unknown operation in trace: " + std::string{fields[1]});
+        auto offset = std::from_chars(fields[0].data(), fields[0].data() + fields[0].size(), entry.offsetMicros);
+        auto detail = std::from_chars(fields[3].data(), fields[3].data() + fields[3].size(), entry.detail);
+        if (offset.ec != std::errc{} || detail.ec != std::errc{})
+            throw std::runtime_error("Malformed number in trace line");
+        for (std::size_t i = 0; i < fields[2].size(); i++)
+        {
+            char c = fields[2][i];
+            if (c == '\\' && i + 1 < fields[2].size())
+            {
+                c = fields[2][++i];
+                c = c == 't' ? '\t' : c == 'n' ? '\n'
+                                              : c;
+            }
+            entry.argument.push_back(c);
+        }
+        return entry;
+    }
+
+    void record(Operation operation, std::string_view argument, std::uint64_t detail) noexcept
+    {
+        auto offset = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+        writeEntry(out_, {static_cast<std::uint64_t>(offset.count()), operation, std::string{argument}, detail});
+    }
+};
+
+/**
+ * @brief runs work(index) for every index below count, spread over the cores. Threads take indexes
+ * from a shared counter so uneven items even out, the calling thread works too and small jobs
+ * don't start any threads at all. The tree must stay unchanged meanwhile, e.g. by holding the storage lock.
+ * @param minPerThread the number of items worth starting another thread for
+ * @throws the first exception thrown by work or by starting a thread, once every thread has stopped
+ */
+template <typename Work>
+void parallelFor(std::size_t count, std::size_t minPerThread, Work work)
+{
+    std::size_t threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                count / std::max<std::size_t>(1, minPerThread));
+    if (threads <= 1)
+    {
+        for (std::size_t index = 0; index < count; index++)
+            work(index);
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::mutex failureMutex;
+    std::exception_ptr failure;
+    auto fail = [&](std::exception_ptr exception)
+    {
+        // hand out no more indexes so every thread winds down
+        next.store(count, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock{failureMutex};
+        if (!failure)
+            failure = exception;
+    };
+    auto run = [&]()
+    {
+        try
+        {
+            for (std::size_t index = next.fetch_add(1, std::memory_order_relaxed); index < count;
+                 index = next.fetch_add(1, std::memory_order_relaxed))
+                work(index);
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+    };
+    std::vector<std::thread> helpers;
+    try
+    {
+        helpers.reserve(threads - 1);
+        for (std::size_t thread = 1; thread < threads; thread++)
+            helpers.emplace_back(run);
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+    run();
+    for (std::thread &helper : helpers)
+        helper.join();
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+/**
+ * @class FileManager
+ * @brief Takes a FileStorage object and helps you do all the CRUD operations on that storage.
+ * One object is meant for one thread, give every thread its own FileManager and output sink.
+ * If another FileManager deletes the current folder (or one of its ancestors), the next operation
+ * of this one fails and moves it to the closest surviving ancestor.
+ */
+class FileManager
+{
+    FileStorage *fileStorage_;
+    // the current folder is resolved again from its path after folders got deleted,
+    // which can happen inside the const printing functions too
+    mutable Folder *currentDirPointer_;
+    mutable std::string currentDirPath_;
+    mutable std::uint64_t folderGeneration_;
+    OutputSink *outputSink_;
+    OutputSink *errorSink_;
+    OperationRecorder *recorder_;
+
+    static std::string getFileExtension(const std::string &fileName)
+    {
+        int fileNameSize = fileName.size();
+        for (int i = fileNameSize - 1; i >= 0; i--)
+        {
+            // going to the last `.`
+            if (fileName[i] == '.')
+            {
+                // updating extension and returning it
+                std::string extension{""};
+                for (int j = i + 1; j < fileNameSize; j++)
+                {
+                    extension.push_back(fileName[j]);
+                }
+                return extension;
+            }
+        }
+        // no extension found
+        return "";
+    }
+
+    /**
+     * @brief split a filePath into a vector from every "/" occurance in it
+     * @param filePath the path to split
+     * @throws std::runtime_error if filePath has preceeding or adjacent "/"
+     */
+    static std::vector<std::string> splitFilePath(const std::string &filePath)
+    {
+        std::vector<std::string> splits;
+        std::size_t index = 0;
+        std::size_t filePath_size = filePath.size();
+
+        if (filePath_size == 0)
+            return splits;
+
+        if (filePath[index] == '/')
+        {
+            Instrumentation::increment(Counter::InvalidPath);
+            throw std::runtime_error("Preceeding \"/\" not allowed in filePath");
+        }
+
+        while (index < filePath_size)
+        {
+            std::string curSplit;
+            while (index < filePath_size && filePath[index] != '/')
+            {
+                curSplit.push_back(filePath[index]);
+                index++;
+            }
+            if (index + 1 < filePath_size && filePath[index + 1] == '/')
+            {
+                Instrumentation::increment(Counter::InvalidPath);
+                throw std::runtime_error("Adjacent \"/\" not allowed in filePath");
+            }
+            splits.push_back(curSplit);
+            index++;
+        }
+
+        return splits;
+    }
+
+    /**
+     * @brief checks if a file or folder name is valid or not
+     * @param name string, the name of file or folder to be validated
+     * @throws std::runtime_error if name is invalid
+     */
+    static void throwIfNameInvalid(const std::string &name)
+    {
+        if (name.find('/') != std::string::npos)
+        {
+            Instrumentation::increment(Counter::InvalidName);
+            throw std::runtime_error("File or folder names can't contain \"/\" in them");
+        }
+        // ".." is the parent link inside Folder::folders_, deleting it would free the parent
+        if (name.empty() || name == "." || name == "..")
+        {
+            Instrumentation::increment(Counter::InvalidName);
+            throw std::runtime_error("File or folder names can't be empty, \".\" or \"..\"");
+        }
+    }
+
+    /**
+     * @brief makes sure currentDirPointer_ is still alive, it's looked up again by its path
+     * whenever folders got deleted since it was last resolved; the storage must be locked
+     * @throws std::runtime_error if the current folder got deleted,
+     * this object is moved to its closest surviving ancestor first
+     */
+    void refreshCurrentFolder() const
+    {
+        std::uint64_t generation = fileStorage_->getFolderGeneration();
+        if (generation == folderGeneration_)
+            return;
+        folderGeneration_ = generation;
+        Folder *folder = fileStorage_->getRootFolder();
+        std::size_t start = 1;
+        while (start < currentDirPath_.size())
+        {
+            std::size_t end = std::min(currentDirPath_.find('/', start), currentDirPath_.size());
+            Folder *child = folder->folders_.find(currentDirPath_.substr(start, end - start));
+            if (child == nullptr)
+            {
+                currentDirPointer_ = folder;
+                currentDirPath_ = folder->metadata_.fullPath_;
+                Instrumentation::increment(Counter::FolderNotFound);
+                throw std::runtime_error("Current folder was deleted, moved to " + currentDirPath_);
+            }
+            folder = child;
+            start = end + 1;
+        }
+        currentDirPointer_ = folder;
+    }
+
+    /**
+     * @brief prints "what: reason" as one line to the error sink
+     */
+    void printError(std::string_view what, const std::exception &e) const noexcept
+    {
+        *errorSink_ << what << ": " << e.what() << '\n';
+        errorSink_->flush();
+    }
+
+public:
+    /**
+     * @brief Create a FileManager object at the root folder
+     * @param fileStorage pointer to an instance of a FileStorage object
+     * that needs to be managed by the this object
+     */
+    FileManager(FileStorage *fileStorage) : fileStorage_{fileStorage}, currentDirPointer_{fileStorage->getRootFolder()}, currentDirPath_{"/"}, folderGeneration_{fileStorage->getFolderGeneration()}, outputSink_{&OutputSink::standardOutput()}, errorSink_{&OutputSink::standardError()}, recorder_{nullptr} {}
+
+    /**
+     * @brief redirect everything this object prints to another sink
+     * @param outputSink the sink to print to, it must outlive this object
+     * or be replaced before it's destroyed
+     */
+    void setOutputSink(OutputSink *outputSink) noexcept
+    {
+        outputSink_ = outputSink;
+    }
+
+    /**
+     * @brief redirect the error messages of this object to another sink, one line each
+     * @param errorSink the sink to print to, it must outlive this object
+     * or be replaced before it's destroyed
+     */
+    void setErrorSink(OutputSink *errorSink) noexcept
+    {
+        errorSink_ = errorSink;
+    }
+
+    /**
+     * @brief record every operation of this object into a replayable trace
+     * @param recorder the recorder to write to, nullptr stops recording
+     */
+    void setOperationRecorder(OperationRecorder *recorder) noexcept
+    {
+        recorder_ = recorder;
+    }
+
+    /**
+     * @brief Create a FileManager object at the specified folder
+     * @param destinationFolder string denoting the location to jump to,
+     * preceeding "/" are not allowed in destinationFolder;
+     * use ".." to go to the parent folder
+     * @param relative boolean telling is the path is relative to current folder
+     * or is it an absolute path from the root folder
+     * @throws std::runtime_error if destinationFolder can't be found,
+     * folder isn't changed in case of this error
+     * (this error is caught and handled internally)
+     */
+    void changeDirectory(std::string destinationFolder, bool relative)
+    {
+        OperationTimer timer{Operation::ChangeDirectory, currentDirPath_, destinationFolder};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::ChangeDirectory, destinationFolder, relative);
+
+        if (currentDirPath_ == destinationFolder)
+            return;
+
+        Folder *tempDirPointer = currentDirPointer_;
+        std::vector<std::string> destinationFolderSpilt;
+
+        if (relative == false)
+        {
+            // returning to the root folder if path is absolute from the root folder
+            tempDirPointer = fileStorage_->getRootFolder();
+        }
+
+        auto lock = fileStorage_->lockShared(Operation::ChangeDirectory);
+        try
+        {
+            // absolute paths don't start from the current folder, so they don't care if it's gone
+            if (relative)
+            {
+                refreshCurrentFolder();
+                tempDirPointer = currentDirPointer_;
+            }
+            timer.enter(Phase::SplitPath);
+            destinationFolderSpilt = splitFilePath(destinationFolder);
+
+            timer.enter(Phase::ResolvePath);
+            for (std::string nextFolderName : destinationFolderSpilt)
+            {
+                if (tempDirPointer->folders_.count(nextFolderName) == 0)
+                {
+                    Instrumentation::increment(Counter::FolderNotFound);
+                    throw std::runtime_error("Destination folder can't be found");
+                }
+                tempDirPointer = tempDirPointer->folders_.find(nextFolderName);
+            }
+
+            // Updating the current instance's currentDir pointer & path
+            // only after the destination folder reached without any errors
+            currentDirPointer_ = tempDirPointer;
+            currentDirPath_ = currentDirPointer_->metadata_.fullPath_;
+            folderGeneration_ = fileStorage_->getFolderGeneration();
+        }
+        catch (const std::runtime_error &e)
+        {
+            printError("Couldn't change directory", e);
+        }
+    }
+
+    /**
+     * @brief prints p50/p99/p999/max latencies of every operation,
+     * recorded by all FileManager objects on all threads
+     */
+    void printLatencyReport() const
+    {
+        MetricsRegistry::instance().printLatencyReport(*outputSink_);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief exports the trace spans recorded so far by all FileManager objects
+     * as Chrome trace JSON through the output sink, tracing has to be turned on
+     * with Tracer::instance().setEnabled(true) beforehand
+     */
+    void exportChromeTrace() const
+    {
+        Tracer::instance().writeChromeTrace(*outputSink_);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the memory held by the whole storage by component,
+     * then the same breakdown for the current folder's subtree and each of its child folders
+     */
+    void printMemoryReport() const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing memory report", e);
+            return;
+        }
+        *outputSink_ << "Memory usage (bytes) of the storage: ";
+        fileStorage_->getMemoryUsage().print(*outputSink_);
+
+        MemoryUsage subtreeUsage;
+        currentDirPointer_->measureSubtreeMemory(subtreeUsage);
+        *outputSink_ << "Memory usage (bytes) of " << currentDirPath_ << ": ";
+        subtreeUsage.print(*outputSink_);
+        for (const auto &curFolder : currentDirPointer_->folders_)
+        {
+            if (curFolder.first == "..")
+                continue;
+            MemoryUsage childUsage;
+            curFolder.second->measureSubtreeMemory(childUsage);
+            *outputSink_ << "Memory usage (bytes) of " << curFolder.second->metadata_.fullPath_ << ": ";
+            childUsage.print(*outputSink_);
+        }
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the folders and files in the current directory whose names are in [from, to),
+     * sorted by name. Large folders keep their names in order, so this only walks the matches there.
+     * @param from the first name to list
+     * @param to the name to stop at, an empty one lists up to the end
+     */
+    void printCurrentFolderRange(const std::string &from, const std::string &to = "") const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing folder range", e);
+            return;
+        }
+        currentDirPointer_->printRange(*outputSink_, from, to);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the names in the current directory that start with prefix, in order and with
+     * a "/" after folders. The sorted names get built by the first completion after a change,
+     * so completions cost a binary search plus the matches.
+     * @param prefix what the names have to start with, an empty one lists everything
+     */
+    void printCompletions(const std::string &prefix) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while completing name", e);
+            return;
+        }
+        std::int64_t built;
+        const auto &names = currentDirPointer_->completionList(built).names;
+        fileStorage_->accountLazyMemory(MemoryUsage::Caches, built);
+        auto match = std::lower_bound(names.begin(), names.end(), prefix, [](const auto &entry, const std::string &text)
+                                      { return *entry.first < text; });
+        *outputSink_ << "Completions: ";
+        for (; match != names.end() && match->first->compare(0, prefix.size(), prefix) == 0; ++match)
+            *outputSink_ << *match->first << (match->second ? "/, " : ", ");
+        *outputSink_ << '\n';
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the full paths of the folders and files named name anywhere under the current
+     * directory, sorted and with a "/" after folders. Subtrees with enough names keep a filter of them,
+     * built by the first search that gets there, and the search skips those that can't hold the name.
+     * @param name the name to look for
+     * @throws std::runtime_error if name is invalid
+     * (caught and handled internally)
+     */
+    void printFindResults(const std::string &name) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+            throwIfNameInvalid(name);
+            std::size_t hash = Folder::nameHash(name);
+            std::vector<std::pair<const std::string *, bool>> found;
+            std::vector<const Folder *> pending{currentDirPointer_};
+            std::int64_t built = 0;
+            while (pending.empty() == false)
+            {
+                const Folder *folder = pending.back();
+                pending.pop_back();
+                if (folder->mayHoldName(hash, built) == false)
+                {
+                    Instrumentation::increment(Counter::SearchSubtreesSkipped);
+                    continue;
+                }
+                if (const Folder *match = folder->folders_.find(name))
+                    found.push_back({&match->metadata_.fullPath_, true});
+                if (const File *match = folder->files_.find(name))
+                    found.push_back({&match->metadata_.fullPath_, false});
+                for (const auto &curFolder : folder->folders_)
+                {
+                    if (curFolder.first != "..")
+                        pending.push_back(curFolder.second);
+                }
+            }
+            fileStorage_->accountLazyMemory(MemoryUsage::Indexes, built);
+            // a folder and a file may share a path, the folder goes first
+            std::sort(found.begin(), found.end(), [](const auto &lhs, const auto &rhs)
+                      {
+                          int order = lhs.first->compare(*rhs.first);
+                          return order != 0 ? order < 0 : lhs.second && rhs.second == false; });
+            *outputSink_ << "Found: ";
+            for (const auto &[path, isFolder] : found)
+                *outputSink_ << *path << (isFolder ? "/, " : ", ");
+            *outputSink_ << '\n';
+            outputSink_->flush();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while finding name", e);
+        }
+    }
+
+    /**
+     * @brief prints the full paths of the files with an extension anywhere under the current directory,
+     * sorted. Every folder counts the extensions of the files below it, so the search skips subtrees
+     * without any such file.
+     * @param extension what comes after the last "." of the names, an empty one finds files without any
+     */
+    void printFindByExtension(const std::string &extension) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while finding extension", e);
+            return;
+        }
+        std::vector<const std::string *> found;
+        std::uint32_t id = 0;
+        std::vector<const Folder *> pending;
+        if (fileStorage_->findExtension(extension, id))
+            pending.push_back(currentDirPointer_);
+        while (pending.empty() == false)
+        {
+            const Folder *folder = pending.back();
+            pending.pop_back();
+            if (folder->filesWithExtension(id) == 0)
+            {
+                Instrumentation::increment(Counter::SearchSubtreesSkipped);
+                continue;
+            }
+            for (const auto &curFile : folder->files_)
+            {
+                if (curFile.second->metadata_.fileExtension_ == extension)
+                    found.push_back(&curFile.second->metadata_.fullPath_);
+            }
+            for (const auto &curFolder : folder->folders_)
+            {
+                if (curFolder.first != "..")
+                    pending.push_back(curFolder.second);
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const std::string *lhs, const std::string *rhs)
+                  { return *lhs < *rhs; });
+        *outputSink_ << "Found: ";
+        for (const std::string *path : found)
+            *outputSink_ << *path << ", ";
+        *outputSink_ << '\n';
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the limit largest files under the current directory with their sizes, largest first and
+     * files of the same size by path. The storage keeps all files ordered by size, so under the root this
+     * costs limit steps through that index. Under other folders the scan passes over files elsewhere too,
+     * once it passed as many as the folder has names below it the folder itself gets walked instead.
+     * @param limit the most files to print
+     */
+    void printLargestFiles(std::size_t limit) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing largest files", e);
+            return;
+        }
+        std::vector<const File *> largest;
+        std::string prefix = currentDirPath_ == "/" ? "/" : currentDirPath_ + "/";
+        std::size_t budget = currentDirPointer_->subtreeNames_;
+        const auto &filesBySize = fileStorage_->getFilesBySize();
+        auto file = filesBySize.begin();
+        for (; file != filesBySize.end() && largest.size() < limit && budget != 0; ++file, budget--)
+        {
+            if ((*file)->metadata_.fullPath_.compare(0, prefix.size(), prefix) == 0)
+                largest.push_back(*file);
+        }
+        if (budget == 0 && largest.size() < limit && file != filesBySize.end())
+        {
+            // a heap of the largest so far with the smallest of them on top
+            File::LargerFirst largerFirst;
+            largest.clear();
+            currentDirPointer_->forEachSubtreeFile([&](const File *candidate)
+                                                   {
+                                                       if (largest.size() < limit)
+                                                       {
+                                                           largest.push_back(candidate);
+                                                           std::push_heap(largest.begin(), largest.end(), largerFirst);
+                                                       }
+                                                       else if (largerFirst(candidate, largest.front()))
+                                                       {
+                                                           std::pop_heap(largest.begin(), largest.end(), largerFirst);
+                                                           largest.back() = candidate;
+                                                           std::push_heap(largest.begin(), largest.end(), largerFirst);
+                                                       } });
+            std::sort_heap(largest.begin(), largest.end(), largerFirst);
+        }
+        *outputSink_ << "Largest files: ";
+        for (const File *curFile : largest)
+            *outputSink_ << curFile->metadata_.fullPath_ << " (" << curFile->metadata_.fileSize_ << " bytes), ";
+        *outputSink_ << '\n';
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the files anywhere in the storage that match a query with their sizes, sorted by path,
+     * e.g. the files over 100 MB not modified for 30 days under some folder. The storage keeps the files
+     * ordered by size and by modification time, so this reads the smaller of the two ranges and not the tree.
+     * @param query the size and modification time ranges and the path prefix the files must have
+     */
+    void printMatchingFiles(const FileQuery &query) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        std::vector<const File *> found = fileStorage_->findFiles(query);
+        std::sort(found.begin(), found.end(), [](const File *lhs, const File *rhs)
+                  { return lhs->metadata_.fullPath_ < rhs->metadata_.fullPath_; });
+        *outputSink_ << "Matching files: ";
+        for (const File *file : found)
+            *outputSink_ << file->metadata_.fullPath_ << " (" << file->metadata_.fileSize_ << " bytes), ";
+        *outputSink_ << '\n';
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief prints the sets of files with the same contents under the current directory, largest files first,
+     * and the bytes deleting all but one file of every set would free. Files are narrowed down by size, then by
+     * a hash of their first 4 KiB, then by a hash of all of it and last by comparing the contents, the hashing
+     * and comparing run on all cores. Empty files are left out, there is nothing to free.
+     */
+    void printDuplicates() const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+            constexpr std::size_t partialHashBytes = 4096;
+            struct Candidate
+            {
+                const File *file;
+                std::size_t hash;
+            };
+            std::vector<Candidate> candidates;
+            currentDirPointer_->forEachSubtreeFile([&](const File *file)
+                                                   {
+                                                       if (file->metadata_.fileSize_ != 0)
+                                                           candidates.push_back({file, 0}); });
+            // the runs of candidates with the same size and hash, only those with more than one survive
+            std::vector<std::pair<std::size_t, std::size_t>> runs;
+            auto keepShared = [&]()
+            {
+                auto key = [](const Candidate &candidate)
+                { return std::make_pair(candidate.file->metadata_.fileSize_, candidate.hash); };
+                std::sort(candidates.begin(), candidates.end(), [&](const Candidate &lhs, const Candidate &rhs)
+                          { return key(lhs) < key(rhs); });
+                std::vector<Candidate> kept;
+                runs.clear();
+                for (std::size_t begin = 0, end = 0; begin < candidates.size(); begin = end)
+                {
+                    while (end < candidates.size() && key(candidates[end]) == key(candidates[begin]))
+                        end++;
+                    if (end - begin < 2)
+                        continue;
+                    runs.push_back({kept.size(), kept.size() + end - begin});
+                    kept.insert(kept.end(), candidates.begin() + begin, candidates.begin() + end);
+                }
+                candidates.swap(kept);
+            };
+            auto hashContent = [](const File *file, std::size_t length)
+            {
+                return std::hash<std::string_view>{}(std::string_view{file->content_}.substr(0, length));
+            };
+
+            keepShared();
+            parallelFor(candidates.size(), 256, [&](std::size_t index)
+                        { candidates[index].hash = hashContent(candidates[index].file, partialHashBytes); });
+            keepShared();
+            // files up to partialHashBytes are hashed whole already
+            parallelFor(candidates.size(), 16, [&](std::size_t index)
+                        {
+                            if (candidates[index].file->metadata_.fileSize_ > partialHashBytes)
+                                candidates[index].hash = hashContent(candidates[index].file, std::string::npos); });
+            keepShared();
+
+            // equal hashes almost always mean equal contents, comparing them makes sure
+            std::vector<std::vector<std::vector<const File *>>> setsByRun(runs.size());
+            parallelFor(runs.size(), 16, [&](std::size_t run)
+                        {
+                            std::vector<const File *> left;
+                            for (std::size_t index = runs[run].first; index < runs[run].second; index++)
+                                left.push_back(candidates[index].file);
+                            while (left.size() > 1)
+                            {
+                                std::vector<const File *> same{left.front()}, different;
+                                for (std::size_t index = 1; index < left.size(); index++)
+                                    (left[index]->content_ == left.front()->content_ ? same : different).push_back(left[index]);
+                                if (same.size() > 1)
+                                    setsByRun[run].push_back(std::move(same));
+                                left.swap(different);
+                            } });
+
+            std::vector<std::vector<const File *>> sets;
+            for (auto &runSets : setsByRun)
+            {
+                for (auto &set : runSets)
+                {
+                    std::sort(set.begin(), set.end(), [](const File *lhs, const File *rhs)
+                              { return lhs->metadata_.fullPath_ < rhs->metadata_.fullPath_; });
+                    sets.push_back(std::move(set));
+                }
+            }
+            std::sort(sets.begin(), sets.end(), [](const auto &lhs, const auto &rhs)
+                      {
+                          if (lhs.front()->metadata_.fileSize_ != rhs.front()->metadata_.fileSize_)
+                              return lhs.front()->metadata_.fileSize_ > rhs.front()->metadata_.fileSize_;
+                          return lhs.front()->metadata_.fullPath_ < rhs.front()->metadata_.fullPath_; });
+            std::uint64_t reclaimable = 0;
+            for (const auto &set : sets)
+            {
+                *outputSink_ << "Duplicates of " << set.front()->metadata_.fileSize_ << " bytes: ";
+                for (const File *file : set)
+                    *outputSink_ << file->metadata_.fullPath_ << ", ";
+                *outputSink_ << '\n';
+                reclaimable += (set.size() - 1) * set.front()->metadata_.fileSize_;
+            }
+            *outputSink_ << "Reclaimable bytes: " << reclaimable << '\n';
+            outputSink_->flush();
+        }
+        catch (const std::exception &e)
+        {
+            // running out of memory or threads, in here or in a worker, ends up here too
+            printError("Error while finding duplicates", e);
+        }
+    }
+
+    /**
+     * @brief prints the bytes, files and folders under every folder down to maxDepth levels below the current
+     * directory, like du or ncdu: one line per folder indented by its depth, the children of a folder largest
+     * first. The files of every folder get summed up on all cores, then the sums are added up the tree once.
+     * @param maxDepth how many levels below the current directory to list, 0 prints only its totals
+     */
+    void printDiskUsage(std::size_t maxDepth) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+            struct Usage
+            {
+                const Folder *folder;
+                std::size_t parent;
+                std::size_t depth;
+                std::uint64_t bytes = 0;
+                std::size_t files = 0;
+                std::size_t folders = 0;
+                std::vector<std::size_t> children;
+
+                Usage(const Folder *folder, std::size_t parent, std::size_t depth) : folder{folder}, parent{parent}, depth{depth} {}
+            };
+            // parents come before their children
+            std::vector<Usage> usages;
+            usages.emplace_back(currentDirPointer_, 0, 0);
+            for (std::size_t index = 0; index < usages.size(); index++)
+            {
+                for (const auto &curFolder : usages[index].folder->folders_)
+                {
+                    if (curFolder.first != "..")
+                        usages.emplace_back(curFolder.second, index, usages[index].depth + 1);
+                }
+            }
+            parallelFor(usages.size(), 64, [&](std::size_t index)
+                        {
+                            Usage &usage = usages[index];
+                            for (const auto &curFile : usage.folder->files_)
+                                usage.bytes += curFile.second->metadata_.fileSize_;
+                            usage.files = usage.folder->files_.size(); });
+            for (std::size_t index = usages.size() - 1; index > 0; index--)
+            {
+                Usage &parent = usages[usages[index].parent];
+                parent.bytes += usages[index].bytes;
+                parent.files += usages[index].files;
+                parent.folders += usages[index].folders + 1;
+                if (usages[index].depth <= maxDepth)
+                    parent.children.push_back(index);
+            }
+
+            std::vector<std::size_t> pending{0};
+            while (pending.empty() == false)
+            {
+                Usage &usage = usages[pending.back()];
+                pending.pop_back();
+                for (std::size_t level = 0; level < usage.depth; level++)
+                    *outputSink_ << "  ";
+                *outputSink_ << usage.bytes << " bytes, " << usage.files << " files, " << usage.folders << " folders: "
+                             << usage.folder->metadata_.fullPath_ << '\n';
+                // largest on top of the stack, ties by path
+                std::sort(usage.children.begin(), usage.children.end(), [&](std::size_t lhs, std::size_t rhs)
+                          {
+                              if (usages[lhs].bytes != usages[rhs].bytes)
+                                  return usages[lhs].bytes < usages[rhs].bytes;
+                              return usages[lhs].folder->metadata_.fullPath_ > usages[rhs].folder->metadata_.fullPath_; });
+                pending.insert(pending.end(), usage.children.begin(), usage.children.end());
+            }
+            outputSink_->flush();
+        }
+        catch (const std::exception &e)
+        {
+            printError("Error while printing disk usage", e);
+        }
+    }
+
+    /**
+     * @brief prints a page of the current directory: at most limit entries in the given order with
+     * ties going by name, by name folders come first and by size or modification time only files
+     * are listed. Only the entries on the page get sorted, so the top 100 of a million files costs
+     * a pass over them and not a full sort.
+     * @param order what files are ordered by
+     * @param limit the most entries to print
+     * @param descending whether the order is reversed, e.g. for the largest or newest files first
+     */
+    void printCurrentFolderSorted(ListingOrder order, std::size_t limit, bool descending = false) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing sorted folder", e);
+            return;
+        }
+        currentDirPointer_->printPage(*outputSink_, order, limit, descending);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief gets the full path of the current working directory
+     */
+    const std::string &getWorkingDirectory() const noexcept
+    {
+        return currentDirPath_;
+    }
+
+    /**
+     * @brief prints the current working directory
+     */
+    void printWorkingDirectory() const noexcept
+    {
+        *outputSink_ << "Current Working Directory: " << currentDirPath_ << '\n';
+        outputSink_->flush();
+    }
+
+    // Adding CRUD functionalities below
+
+    /**
+     * @brief create a folder in current directory
+     * @param folderName denoting the name of folder to be created
+     * @throws std::runtime_error if folderName already exists
+     * (caught and handled internally)
+     */
+    void createFolder(std::string folderName)
+    {
+        OperationTimer timer{Operation::CreateFolder, currentDirPath_, folderName};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::CreateFolder, folderName, 0);
+        auto lock = fileStorage_->lockExclusive(Operation::CreateFolder);
+        try
+        {
+            timer.enter(Phase::ResolvePath);
+            refreshCurrentFolder();
+            throwIfNameInvalid(folderName);
+            if (currentDirPointer_->folders_.count(folderName) != 0)
+            {
+                Instrumentation::increment(Counter::FolderAlreadyExists);
+                throw std::runtime_error("Folder already exists");
+            }
+            timer.enter(Phase::Allocate);
+            std::string newFolderPath = currentDirPath_;
+            if (currentDirPath_ == "/")
+                newFolderPath += folderName;
+            else
+                newFolderPath += "/" + folderName;
+            Folder *newFolderPointer = new Folder(newFolderPath, currentDirPointer_);
+            timer.enter(Phase::UpdateIndex);
+            MemoryUsage delta;
+            delta.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+            delta.bytes[MemoryUsage::Caches] -= currentDirPointer_->completionBytes();
+            currentDirPointer_->addFolder(folderName, newFolderPointer);
+            currentDirPointer_->noteNameAdded(Folder::nameHash(folderName), delta);
+            delta.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+            delta.bytes[MemoryUsage::Names] += MemoryUsage::stringCopyBytes(folderName.size());
+            newFolderPointer->measureOwnMemory(delta);
+            fileStorage_->accountMemory(delta);
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while creating folder", e);
+        }
+    }
+
+    /**
+     * @brief create a file in current directory
+     * @param fileName denoting the name of file to be created
+     * @param fileContent denoting the content of the file
+     * @throws std::runtime_error if fileName already exists
+     * (caught and handled internally)
+     */
+    void createFile(std::string fileName, std::string fileContent = "")
+    {
+        OperationTimer timer{Operation::CreateFile, currentDirPath_, fileName};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::CreateFile, fileName, fileContent.size());
+        timer.setContentBytes(fileContent.size());
+        auto lock = fileStorage_->lockExclusive(Operation::CreateFile);
+        try
+        {
+            timer.enter(Phase::ResolvePath);
+            refreshCurrentFolder();
+            throwIfNameInvalid(fileName);
+            if (currentDirPointer_->files_.count(fileName) != 0)
+            {
+                Instrumentation::increment(Counter::FileAlreadyExists);
+                throw std::runtime_error("File already exists");
+            }
+            timer.enter(Phase::Allocate);
+            std::string newFilePath = currentDirPath_;
+            if (currentDirPath_ == "/")
+                newFilePath += fileName;
+            else
+                newFilePath += "/" + fileName;
+            std::string extension = getFileExtension(fileName);
+            std::uint32_t extensionId = fileStorage_->internExtension(extension);
+            File *newFilePointer = new File(std::move(newFilePath), std::move(extension), std::move(fileContent));
+            timer.enter(Phase::UpdateIndex);
+            MemoryUsage delta;
+            delta.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+            delta.bytes[MemoryUsage::Caches] -= currentDirPointer_->completionBytes();
+            currentDirPointer_->addFile(fileName, newFilePointer);
+            currentDirPointer_->noteNameAdded(Folder::nameHash(fileName), delta);
+            currentDirPointer_->noteExtensionAdded(extensionId, delta);
+            fileStorage_->indexFile(newFilePointer);
+            delta.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+            delta.bytes[MemoryUsage::Names] += MemoryUsage::stringCopyBytes(fileName.size());
+            newFilePointer->measureMemory(delta);
+            fileStorage_->accountMemory(delta);
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while creating file", e);
+        }
+    }
+
+    /**
+     * @brief create many folders in current directory at once,
+     * the folder table is grown once up front instead of rehashing along the way
+     * @param folderNames names of the folders to be created
+     * @return number of folders created
+     * @throws std::runtime_error for every name that is invalid or already exists,
+     * that name is skipped (caught and handled internally)
+     */
+    std::size_t createFolders(std::vector<std::string> folderNames)
+    {
+        OperationTimer timer{Operation::CreateFolders, currentDirPath_, ""};
+        auto lock = fileStorage_->lockExclusive(Operation::CreateFolders);
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while creating folders", e);
+            return 0;
+        }
+        std::size_t created = 0;
+        std::string pathPrefix = currentDirPath_ == "/" ? "/" : currentDirPath_ + "/";
+        MemoryUsage delta;
+        delta.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+        delta.bytes[MemoryUsage::Caches] -= currentDirPointer_->completionBytes();
+        currentDirPointer_->reserveFolders(folderNames.size());
+        for (std::string &folderName : folderNames)
+        {
+            if (recorder_ != nullptr)
+                recorder_->record(Operation::CreateFolder, folderName, 0);
+            try
+            {
+                throwIfNameInvalid(folderName);
+                if (currentDirPointer_->folders_.count(folderName) != 0)
+                {
+                    Instrumentation::increment(Counter::FolderAlreadyExists);
+                    throw std::runtime_error("Folder already exists");
+                }
+                Folder *newFolderPointer = new Folder(pathPrefix + folderName, currentDirPointer_);
+                delta.bytes[MemoryUsage::Names] += MemoryUsage::stringBytes(folderName);
+                newFolderPointer->measureOwnMemory(delta);
+                currentDirPointer_->noteNameAdded(Folder::nameHash(folderName), delta);
+                currentDirPointer_->addFolder(std::move(folderName), newFolderPointer);
+                created++;
+            }
+            catch (std::runtime_error &e)
+            {
+                printError("Error while creating folder", e);
+            }
+        }
+        delta.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+        fileStorage_->accountMemory(delta);
+        return created;
+    }
+
+    /**
+     * @brief create many files in current directory at once,
+     * the file table is grown once up front instead of rehashing along the way
+     * and the contents are moved into the files instead of being copied
+     * @param files pairs of file name and file content
+     * @return number of files created
+     * @throws std::runtime_error for every name that is invalid or already exists,
+     * that file is skipped (caught and handled internally)
+     */
+    std::size_t createFiles(std::vector<std::pair<std::string, std::string>> files)
+    {
+        OperationTimer timer{Operation::CreateFiles, currentDirPath_, ""};
+        auto lock = fileStorage_->lockExclusive(Operation::CreateFiles);
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while creating files", e);
+            return 0;
+        }
+        std::size_t created = 0;
+        std::uint64_t contentBytes = 0;
+        std::string pathPrefix = currentDirPath_ == "/" ? "/" : currentDirPath_ + "/";
+        MemoryUsage delta;
+        delta.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+        delta.bytes[MemoryUsage::Caches] -= currentDirPointer_->completionBytes();
+        currentDirPointer_->reserveFiles(files.size());
+        for (auto &[fileName, fileContent] : files)
+        {
+            if (recorder_ != nullptr)
+                recorder_->record(Operation::CreateFile, fileName, fileContent.size());
+            try
+            {
+                throwIfNameInvalid(fileName);
+                if (currentDirPointer_->files_.count(fileName) != 0)
+                {
+                    Instrumentation::increment(Counter::FileAlreadyExists);
+                    throw std::runtime_error("File already exists");
+                }
+                contentBytes += fileContent.size();
+                std::string extension = getFileExtension(fileName);
+                std::uint32_t extensionId = fileStorage_->internExtension(extension);
+                File *newFilePointer = new File(pathPrefix + fileName, std::move(extension), std::move(fileContent));
+                delta.bytes[MemoryUsage::Names] += MemoryUsage::stringBytes(fileName);
+                newFilePointer->measureMemory(delta);
+                currentDirPointer_->noteNameAdded(Folder::nameHash(fileName), delta);
+                currentDirPointer_->noteExtensionAdded(extensionId, delta);
+                fileStorage_->indexFile(newFilePointer);
+                currentDirPointer_->addFile(std::move(fileName), newFilePointer);
+                created++;
+            }
+            catch (std::runtime_error &e)
+            {
+                printError("Error while creating file", e);
+            }
+        }
+        delta.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+        fileStorage_->accountMemory(delta);
+        timer.setContentBytes(contentBytes);
+        return created;
+    }
+
+    /**
+     * @brief update a file in current directory
+     * @param fileName denoting the name of file to be updated
+     * @param fileContent denoting the content of the file
+     * @throws std::runtime_error if fileName doesn't exist
+     * (caught and handled internally)
+     */
+    void updateFile(std::string fileName, std::string fileContent)
+    {
+        OperationTimer timer{Operation::UpdateFile, currentDirPath_, fileName};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::UpdateFile, fileName, fileContent.size());
+        timer.setContentBytes(fileContent.size());
+        auto lock = fileStorage_->lockExclusive(Operation::UpdateFile);
+        try
+        {
+            timer.enter(Phase::ResolvePath);
+            refreshCurrentFolder();
+            throwIfNameInvalid(fileName);
+            if (currentDirPointer_->files_.count(fileName) == 0)
+            {
+                Instrumentation::increment(Counter::FileNotFound);
+                throw std::runtime_error("File doesn't exist");
+            }
+            timer.enter(Phase::WriteContent);
+            File *file = currentDirPointer_->files_.find(fileName);
+            MemoryUsage delta;
+            delta.bytes[MemoryUsage::Content] -= MemoryUsage::stringBytes(file->content_);
+            fileStorage_->unindexFile(file);
+            file->updateContent(fileContent);
+            fileStorage_->indexFile(file);
+            delta.bytes[MemoryUsage::Content] += MemoryUsage::stringBytes(file->content_);
+            fileStorage_->accountMemory(delta);
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while updating file", e);
+        }
+    }
+
+    /**
+     * @brief print contents of the current folder
+     */
+    void printCurrentFolderContents() const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing folder", e);
+            return;
+        }
+        currentDirPointer_->printContents(*outputSink_);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief export the current folder as JSON through the output sink
+     * @param recursive whether to export the whole subtree
+     * or just the direct children of the current folder
+     */
+    void exportCurrentFolderJson(bool recursive) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while exporting folder", e);
+            return;
+        }
+        JsonWriter json{*outputSink_};
+        std::string_view name = currentDirPath_.substr(currentDirPath_.find_last_of('/') + 1);
+        currentDirPointer_->writeJson(json, name.empty() ? "/" : name, recursive);
+        outputSink_->put('\n');
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief export the current folder as newline delimited JSON (one node per line)
+     * through the output sink
+     * @param recursive whether to export the whole subtree
+     * or just the direct children of the current folder
+     */
+    void exportCurrentFolderNdjson(bool recursive) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while exporting folder", e);
+            return;
+        }
+        currentDirPointer_->writeNdjson(*outputSink_, recursive);
+        outputSink_->flush();
+    }
+
+    /**
+     * @brief print contents of the current file
+     * @throws std::runtime_error if fileName doesn't exist
+     * (caught and handled internally)
+     */
+    void printFileContents(std::string fileName) const noexcept
+    {
+        auto lock = fileStorage_->lockShared();
+        try
+        {
+            refreshCurrentFolder();
+            throwIfNameInvalid(fileName);
+            if (currentDirPointer_->files_.count(fileName) == 0)
+            {
+                Instrumentation::increment(Counter::FileNotFound);
+                throw std::runtime_error("File doesn't exist");
+            }
+            currentDirPointer_->files_.find(fileName)->printContents(*outputSink_);
+            outputSink_->flush();
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while printing file", e);
+        }
+    }
+
+    /**
+     * @brief delete a folder in current directory
+     * @param folderName denoting the name of folder to be deleted
+     * @throws std::runtime_error if folderName doesn't exist
+     * (caught and handled internally)
+     */
+    void deleteFolder(std::string folderName)
+    {
+        OperationTimer timer{Operation::DeleteFolder, currentDirPath_, folderName};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::DeleteFolder, folderName, 0);
+        auto lock = fileStorage_->lockExclusive(Operation::DeleteFolder);
+        try
+        {
+            timer.enter(Phase::ResolvePath);
+            refreshCurrentFolder();
+            throwIfNameInvalid(folderName);
+            if (currentDirPointer_->folders_.count(folderName) == 0)
+            {
+                Instrumentation::increment(Counter::FolderNotFound);
+                throw std::runtime_error("Folder doesn't exist");
+            }
+            timer.enter(Phase::FreeNodes);
+            timer.countFreedNodes();
+            MemoryUsage freed;
+            const Folder *folder = currentDirPointer_->folders_.find(folderName);
+            folder->measureSubtreeMemory(freed);
+            std::vector<std::size_t> removedNames{Folder::nameHash(folderName)};
+            removedNames.reserve(folder->subtreeNames_ + 1);
+            folder->forEachSubtreeName([&](const std::string &name)
+                                       { removedNames.push_back(Folder::nameHash(name)); });
+            currentDirPointer_->noteNamesRemoved(removedNames);
+            currentDirPointer_->noteExtensionsRemoved(folder->extensionCounts_, freed);
+            folder->forEachSubtreeFile([&](const File *file)
+                                       { fileStorage_->unindexFile(file); });
+            freed.bytes[MemoryUsage::Names] += MemoryUsage::stringCopyBytes(folderName.size());
+            freed.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+            freed.bytes[MemoryUsage::Caches] += currentDirPointer_->completionBytes();
+            currentDirPointer_->removeFolder(folderName);
+            fileStorage_->noteFolderDeleted();
+            freed.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+            fileStorage_->accountMemory(MemoryUsage{} -= freed);
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while deleting folder", e);
+        }
+    }
+
+    /**
+     * @brief delete a file in current directory
+     * @param folderName denoting the name of file to be deleted
+     * @throws std::runtime_error if fileName doesn't exist
+     * (caught and handled internally)
+     */
+    void deleteFile(std::string fileName)
+    {
+        OperationTimer timer{Operation::DeleteFile, currentDirPath_, fileName};
+        if (recorder_ != nullptr)
+            recorder_->record(Operation::DeleteFile, fileName, 0);
+        auto lock = fileStorage_->lockExclusive(Operation::DeleteFile);
+        try
+        {
+            timer.enter(Phase::ResolvePath);
+            refreshCurrentFolder();
+            throwIfNameInvalid(fileName);
+            if (currentDirPointer_->files_.count(fileName) == 0)
+            {
+                Instrumentation::increment(Counter::FileNotFound);
+                throw std::runtime_error("File doesn't exist");
+            }
+            timer.enter(Phase::FreeNodes);
+            timer.countFreedNodes();
+            MemoryUsage freed;
+            const File *file = currentDirPointer_->files_.find(fileName);
+            file->measureMemory(freed);
+            currentDirPointer_->noteNamesRemoved({Folder::nameHash(fileName)});
+            std::uint32_t extensionId = 0;
+            fileStorage_->findExtension(file->metadata_.fileExtension_, extensionId);
+            currentDirPointer_->noteExtensionsRemoved({{extensionId, 1}}, freed);
+            fileStorage_->unindexFile(file);
+            freed.bytes[MemoryUsage::Names] += MemoryUsage::stringCopyBytes(fileName.size());
+            freed.bytes[MemoryUsage::ChildTables] += currentDirPointer_->childTablesBytes();
+            freed.bytes[MemoryUsage::Caches] += currentDirPointer_->completionBytes();
+            currentDirPointer_->removeFile(fileName);
+            freed.bytes[MemoryUsage::ChildTables] -= currentDirPointer_->childTablesBytes();
+            fileStorage_->accountMemory(MemoryUsage{} -= freed);
+        }
+        catch (std::runtime_error &e)
+        {
+            printError("Error while deleting file", e);
+        }
+    }
+};
+
+#endif // FILE_MANAGER_HPP
@@ -0,0 +1,407 @@
+/**
+ * @file bench.cpp
+ * @brief Microbenchmarks of the core FileManager operations, built as fm-bench
+ */
+
+#include "file_manager.hpp"
+#include "tool_options.hpp"
+
+/**
+ * @class BenchmarkSuite
+ * @brief Microbenchmarks of the core FileManager operations, run with `fm-bench [options]`.
+ * Every case runs against a chain of `depth` nested folders with `fanOut` files and
+ * `fanOut` folders next to every link, operations happen in the deepest folder.
+ * Results are printed as JSON with a fixed key order so runs can be diffed over time.
+ */
+class BenchmarkSuite
+{
+private:
+    struct Shape
+    {
+        std::size_t fanOut;
+        std::size_t depth;
+        std::size_t contentSize;
+    };
+
+    struct Measurement
+    {
+        std::uint64_t nanoseconds;
+        std::size_t operations;
+    };
+
+    struct Case
+    {
+        const char *name;
+        Measurement (BenchmarkSuite::*run)();
+    };
+
+    std::vector<std::size_t> fanOuts_{10, 1000};
+    std::vector<std::size_t> depths_{1, 8};
+    std::vector<std::size_t> contentSizes_{0, 4096};
+    std::size_t iterations_{10000};
+    std::size_t repetitions_{5};
+    std::string filter_;
+
+    // state of the shape being measured
+    Shape shape_{};
+    // the storage and file manager print here (errors of the miss cases, storage teardown),
+    // results go to the sink given to run()
+    NullOutputSink quiet_;
+    std::unique_ptr<FileStorage> storage_;
+    std::unique_ptr<FileManager> fileManager_;
+    std::string leafName_;
+    std::string leafPath_;
+    std::string content_;
+    std::string otherContent_;
+
+    using Clock = std::chrono::steady_clock;
+
+    static std::uint64_t elapsedSince(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    static std::string numberedName(const char *prefix, std::size_t number)
+    {
+        return prefix + std::to_string(number);
+    }
+
+    void buildShape(const Shape &shape)
+    {
+        shape_ = shape;
+        fileManager_.reset();
+        storage_ = std::make_unique<FileStorage>(&quiet_);
+        fileManager_ = std::make_unique<FileManager>(storage_.get());
+        fileManager_->setOutputSink(&quiet_);
+        fileManager_->setErrorSink(&quiet_);
+        content_.assign(shape.contentSize, 'a');
+        otherContent_.assign(shape.contentSize, 'b');
+        leafPath_.clear();
+        for (std::size_t level = 0; level < shape.depth; level++)
+        {
+            for (std::size_t i = 0; i < shape.fanOut; i++)
+            {
+                fileManager_->createFolder(numberedName("folder", i));
+                fileManager_->createFile(numberedName("file", i), content_);
+            }
+            leafName_ = numberedName("chain", level);
+            fileManager_->createFolder(leafName_);
+            fileManager_->changeDirectory(leafName_, true);
+            leafPath_ += (level == 0 ? "" : "/") + leafName_;
+        }
+        for (std::size_t i = 0; i < shape.fanOut; i++)
+        {
+            fileManager_->createFolder(numberedName("folder", i));
+            fileManager_->createFile(numberedName("file", i), content_);
+        }
+    }
+
+    Measurement createFolder()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->createFolder(numberedName("bench", i));
+        std::uint64_t elapsed = elapsedSince(start);
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->deleteFolder(numberedName("bench", i));
+        return {elapsed, iterations_};
+    }
+
+    Measurement createFile()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->createFile(numberedName("bench", i), content_);
+        std::uint64_t elapsed = elapsedSince(start);
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->deleteFile(numberedName("bench", i));
+        return {elapsed, iterations_};
+    }
+
+    Measurement changeDirectoryRelativeHit()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+        {
+            fileManager_->changeDirectory("..", true);
+            fileManager_->changeDirectory(leafName_, true);
+        }
+        return {elapsedSince(start), 2 * iterations_};
+    }
+
+    Measurement changeDirectoryAbsoluteHit()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->changeDirectory(leafPath_, false);
+        return {elapsedSince(start), iterations_};
+    }
+
+    Measurement changeDirectoryRelativeMiss()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->changeDirectory("missing", true);
+        return {elapsedSince(start), iterations_};
+    }
+
+    Measurement changeDirectoryAbsoluteMiss()
+    {
+        std::string missingPath = leafPath_ + "/missing";
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->changeDirectory(missingPath, false);
+        fileManager_->changeDirectory(leafPath_, false);
+        return {elapsedSince(start), iterations_};
+    }
+
+    Measurement updateFile()
+    {
+        fileManager_->createFile("bench", content_);
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->updateFile("bench", i % 2 == 0 ? otherContent_ : content_);
+        std::uint64_t elapsed = elapsedSince(start);
+        fileManager_->deleteFile("bench");
+        return {elapsed, iterations_};
+    }
+
+    Measurement deleteFile()
+    {
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->createFile(numberedName("bench", i), content_);
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->deleteFile(numberedName("bench", i));
+        return {elapsedSince(start), iterations_};
+    }
+
+    Measurement deleteEmptyFolder()
+    {
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->createFolder(numberedName("bench", i));
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations_; i++)
+            fileManager_->deleteFolder(numberedName("bench", i));
+        return {elapsedSince(start), iterations_};
+    }
+
+    Measurement deleteFolderSubtree()
+    {
+        // every deleted folder holds fanOut files, so fewer of them are needed
+        std::size_t folders = std::max<std::size_t>(1, iterations_ / std::max<std::size_t>(1, shape_.fanOut));
+        for (std::size_t i = 0; i < folders; i++)
+        {
+            fileManager_->createFolder(numberedName("bench", i));
+            fileManager_->changeDirectory(numberedName("bench", i), true);
+            for (std::size_t j = 0; j < shape_.fanOut; j++)
+                fileManager_->createFile(numberedName("file", j), content_);
+            fileManager_->changeDirectory("..", true);
+        }
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < folders; i++)
+            fileManager_->deleteFolder(numberedName("bench", i));
+        return {elapsedSince(start), folders};
+    }
+
+    std::size_t listingIterations() const
+    {
+        return std::max<std::size_t>(1, iterations_ / std::max<std::size_t>(1, 2 * shape_.fanOut));
+    }
+
+    Measurement listText()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < listingIterations(); i++)
+            fileManager_->printCurrentFolderContents();
+        std::uint64_t elapsed = elapsedSince(start);
+        return {elapsed, listingIterations()};
+    }
+
+    /**
+     * @brief the first page of a listing, files largest first, only the page gets sorted
+     */
+    Measurement listTopBySize()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < listingIterations(); i++)
+            fileManager_->printCurrentFolderSorted(ListingOrder::Size, 100, true);
+        std::uint64_t elapsed = elapsedSince(start);
+        return {elapsed, listingIterations()};
+    }
+
+    Measurement listNdjson()
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < listingIterations(); i++)
+            fileManager_->exportCurrentFolderNdjson(false);
+        std::uint64_t elapsed = elapsedSince(start);
+        return {elapsed, listingIterations()};
+    }
+
+    /**
+     * @brief searches the whole tree from the root for a name that isn't there,
+     * the first search builds the name filters and the rest skip what they rule out
+     */
+    Measurement findAbsent()
+    {
+        fileManager_->changeDirectory("", false);
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < listingIterations(); i++)
+            fileManager_->printFindResults("missing");
+        std::uint64_t elapsed = elapsedSince(start);
+        fileManager_->changeDirectory(leafPath_, false);
+        return {elapsed, listingIterations()};
+    }
+
+    Measurement listLargest()
+    {
+        fileManager_->changeDirectory("", false);
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < listingIterations(); i++)
+            fileManager_->printLargestFiles(100);
+        std::uint64_t elapsed = elapsedSince(start);
+        fileManager_->changeDirectory(leafPath_, false);
+        return {elapsed, listingIterations()};
+    }
+
+    static constexpr Case kCases[] = {
+        {"createFolder", &BenchmarkSuite::createFolder},
+        {"createFile", &BenchmarkSuite::createFile},
+        {"changeDirectory/relative/hit", &BenchmarkSuite::changeDirectoryRelativeHit},
+        {"changeDirectory/absolute/hit", &BenchmarkSuite::changeDirectoryAbsoluteHit},
+        {"changeDirectory/relative/miss", &BenchmarkSuite::changeDirectoryRelativeMiss},
+        {"changeDirectory/absolute/miss", &BenchmarkSuite::changeDirectoryAbsoluteMiss},
+        {"updateFile", &BenchmarkSuite::updateFile},
+        {"deleteFile", &BenchmarkSuite::deleteFile},
+        {"deleteFolder/empty", &BenchmarkSuite::deleteEmptyFolder},
+        {"deleteFolder/subtree", &BenchmarkSuite::deleteFolderSubtree},
+        {"listing/text", &BenchmarkSuite::listText},
+        {"listing/ndjson", &BenchmarkSuite::listNdjson},
+        {"listing/top100/size", &BenchmarkSuite::listTopBySize},
+        {"find/absent", &BenchmarkSuite::findAbsent},
+        {"largest/top100", &BenchmarkSuite::listLargest},
+    };
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--fan-out")
+                fanOuts_ = parseSizes(value);
+            else if (option == "--depth")
+                depths_ = parseSizes(value);
+            else if (option == "--content-size")
+                contentSizes_ = parseSizes(value);
+            else if (option == "--iterations")
+                iterations_ = parseSizes(value).at(0);
+            else if (option == "--repetitions")
+                repetitions_ = parseSizes(value).at(0);
+            else if (option == "--filter")
+                filter_ = value;
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+        for (std::size_t depth : depths_)
+        {
+            if (depth == 0)
+                throw std::runtime_error("Depth has to be at least 1");
+        }
+        if (iterations_ == 0 || repetitions_ == 0)
+            throw std::runtime_error("Iterations and repetitions have to be at least 1");
+    }
+
+    void run(OutputSink &out)
+    {
+        JsonWriter json{out};
+        json.beginObject();
+        json.key("context").beginObject()
+            .field("instrumentation", Instrumentation::enabled)
+            .field("iterations", iterations_)
+            .field("repetitions", repetitions_)
+            .endObject();
+        json.key("benchmarks").beginArray();
+        for (std::size_t fanOut : fanOuts_)
+        {
+            for (std::size_t depth : depths_)
+            {
+                for (std::size_t contentSize : contentSizes_)
+                {
+                    buildShape({fanOut, depth, contentSize});
+                    for (const Case &benchmarkCase : kCases)
+                    {
+                        if (std::string_view{benchmarkCase.name}.find(filter_) == std::string_view::npos)
+                            continue;
+                        std::vector<double> nsPerOp;
+                        std::size_t operations = 0;
+                        for (std::size_t repetition = 0; repetition < repetitions_; repetition++)
+                        {
+                            Measurement measurement = (this->*benchmarkCase.run)();
+                            nsPerOp.push_back(static_cast<double>(measurement.nanoseconds) / measurement.operations);
+                            operations = measurement.operations;
+                        }
+                        std::sort(nsPerOp.begin(), nsPerOp.end());
+                        out.put('\n');
+                        json.beginObject()
+                            .field("name", benchmarkCase.name)
+                            .field("fanOut", fanOut)
+                            .field("depth", depth)
+                            .field("contentSize", contentSize)
+                            .field("operations", operations);
+                        json.key("nsPerOp").beginObject()
+                            .field("min", nsPerOp.front())
+                            .field("median", nsPerOp[nsPerOp.size() / 2])
+                            .field("max", nsPerOp.back())
+                            .endObject();
+                        json.endObject();
+                        out.flush();
+                    }
+                }
+            }
+        }
+        fileManager_.reset();
+        storage_.reset();
+        out.put('\n');
+        json.endArray().endObject();
+        out.put('\n');
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-bench`
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        BenchmarkSuite suite;
+        try
+        {
+            suite.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing benchmark options: " << e.what() << "\n"
+                      << "Usage: fm-bench [--fan-out N,...] [--depth N,...] [--content-size N,...]"
+                      << " [--iterations N] [--repetitions N] [--filter NAME]" << std::endl;
+            return 1;
+        }
+
+        // results go straight to the standard output descriptor
+        FdOutputSink out{STDOUT_FILENO};
+        suite.run(out);
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return BenchmarkSuite::main(argc - 1, argv + 1);
+}
@@ -0,0 +1,1151 @@
+/**
+ * @file fuzz.cpp
+ * @brief Differential fuzzer comparing FileManager against a reference model, built as fm-fuzz
+ */
+
+#include "file_manager.hpp"
+
+#include <random>
+
+/**
+ * @class DeterministicScheduler
+ * @brief Runs the steps of several logical clients, every client on a thread of its own but strictly
+ * one at a time, in an order drawn from a seed. The turn is handed over through a mutex, so everything
+ * a client did happens-before the next client's step, and a run interleaves exactly the same way
+ * whenever its seed is repeated. Clients switch between steps; a step that wants to be preempted
+ * in the middle has to be split into several steps.
+ */
+class DeterministicScheduler
+{
+private:
+    static constexpr std::size_t kNobody = std::numeric_limits<std::size_t>::max();
+
+    std::size_t clients_;
+    std::mt19937_64 random_;
+    double switchProbability_;
+    std::function<void(std::size_t)> step_;
+    std::size_t last_;
+
+    std::mutex mutex_;
+    std::condition_variable turnChanged_;
+    std::size_t turn_;
+    bool stopping_;
+    std::exception_ptr failure_;
+    std::vector<std::thread> threads_;
+
+    void clientLoop(std::size_t client) noexcept
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        while (true)
+        {
+            turnChanged_.wait(lock, [this, client]
+                              { return turn_ == client || stopping_; });
+            if (stopping_)
+                return;
+            lock.unlock();
+            std::exception_ptr failure;
+            try
+            {
+                step_(client);
+            }
+            catch (...)
+            {
+                failure = std::current_exception();
+            }
+            lock.lock();
+            failure_ = failure;
+            turn_ = kNobody;
+            turnChanged_.notify_all();
+        }
+    }
+
+public:
+    /**
+     * @param switchProbability chance that the next step goes to a randomly picked client
+     * instead of the one that ran last, low values give long bursts of a single client
+     * @param step runs one step of the given client, on that client's thread
+     */
+    DeterministicScheduler(std::size_t clients, std::uint64_t seed, double switchProbability, std::function<void(std::size_t)> step)
+        : clients_{clients}, random_{seed}, switchProbability_{switchProbability}, step_{std::move(step)},
+          last_{kNobody}, turn_{kNobody}, stopping_{false}
+    {
+        for (std::size_t client = 0; client < clients_; client++)
+            threads_.emplace_back(&DeterministicScheduler::clientLoop, this, client);
+    }
+    DeterministicScheduler(const DeterministicScheduler &) = delete;
+    DeterministicScheduler &operator=(const DeterministicScheduler &) = delete;
+
+    /**
+     * @brief picks the next client from the seed and waits until it has run one step
+     * @return the client that ran
+     * @throws whatever the step threw
+     */
+    std::size_t runNext()
+    {
+        if (last_ == kNobody || std::uniform_real_distribution<double>{0, 1}(random_) < switchProbability_)
+            last_ = std::uniform_int_distribution<std::size_t>{0, clients_ - 1}(random_);
+        std::unique_lock<std::mutex> lock{mutex_};
+        turn_ = last_;
+        turnChanged_.notify_all();
+        turnChanged_.wait(lock, [this]
+                          { return turn_ == kNobody; });
+        if (failure_ != nullptr)
+            std::rethrow_exception(std::exchange(failure_, nullptr));
+        return last_;
+    }
+
+    ~DeterministicScheduler()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stopping_ = true;
+        }
+        turnChanged_.notify_all();
+        for (std::thread &thread : threads_)
+            thread.join();
+    }
+};
+
+/**
+ * @class DifferentialFuzzer
+ * @brief Property tester, run with `fm-fuzz [options]`. Applies random operation sequences to a
+ * FileManager and to a deliberately naive model of the tree, and compares everything observable
+ * after every step: reported errors, return values, printed file contents, the working directory
+ * and the listings of the current folder and of name ranges in it. Every few steps the whole tree
+ * (as NDJSON), the memory accounting and the node counters are compared as well. Names are drawn
+ * from a small pool with reserved and malformed names mixed in, so collisions and error paths
+ * come up all the time.
+ * With several clients, each one is a FileManager on a thread of its own, interleaved by a
+ * DeterministicScheduler, so they delete folders from under each other reproducibly.
+ * Build with -fsanitize=address,undefined to also catch memory errors along the way.
+ */
+class DifferentialFuzzer
+{
+private:
+    struct ModelFolder
+    {
+        std::string path;
+        ModelFolder *parent;
+        std::map<std::string, std::unique_ptr<ModelFolder>> folders;
+        std::map<std::string, std::string> files;
+    };
+
+    struct Client
+    {
+        std::unique_ptr<StringOutputSink> out;
+        std::unique_ptr<FileManager> fileManager;
+        // where the model thinks the client is, it may have been deleted by another client since
+        std::string path;
+    };
+
+    std::uint64_t seed_{1};
+    std::size_t runs_{20};
+    std::size_t steps_{20000};
+    std::size_t checkEvery_{64};
+    std::size_t clientCount_{1};
+    double switchProbability_{0.5};
+
+    // state of the run in progress
+    std::mt19937_64 random_;
+    std::unique_ptr<ModelFolder> root_;
+    ModelFolder *current_;
+    std::vector<Client> clients_;
+    // the error sink of every file manager, one line per error message
+    StringOutputSink errors_;
+    // errors the step in progress has to report
+    std::size_t expectedErrors_;
+    std::deque<std::string> recentSteps_;
+
+    static constexpr std::size_t kRecentSteps = 16;
+
+    std::size_t pickIndex(std::size_t size)
+    {
+        return std::uniform_int_distribution<std::size_t>{0, size - 1}(random_);
+    }
+
+    bool chance(double probability)
+    {
+        return std::uniform_real_distribution<double>{0, 1}(random_) < probability;
+    }
+
+    std::string pickName()
+    {
+        static const char *const names[] = {"a", "b", "c", "a.txt", "b.md", "c.tar.gz", ".hidden", "x."};
+        // reserved and malformed names the file manager has to reject
+        static const char *const badNames[] = {"", ".", "..", "a/b", "/", "a/"};
+        if (chance(0.08))
+            return badNames[pickIndex(std::size(badNames))];
+        return names[pickIndex(std::size(names))];
+    }
+
+    std::string pickContent()
+    {
+        static const char *const contents[] = {"", "x", "hello", "line\nbreak", "{\"json\": true}", "0123456789abcdef"};
+        return contents[pickIndex(std::size(contents))];
+    }
+
+    static std::string childPath(const ModelFolder &parent, const std::string &name)
+    {
+        return parent.path == "/" ? "/" + name : parent.path + "/" + name;
+    }
+
+    static std::string extensionOf(const std::string &name)
+    {
+        std::size_t dot = name.find_last_of('.');
+        return dot == std::string::npos ? "" : name.substr(dot + 1);
+    }
+
+    static bool validName(const std::string &name)
+    {
+        return name.find('/') == std::string::npos && name != "" && name != "." && name != "..";
+    }
+
+    void collectFolders(ModelFolder &folder, std::vector<ModelFolder *> &folders)
+    {
+        folders.push_back(&folder);
+        for (auto &child : folder.folders)
+            collectFolders(*child.second, folders);
+    }
+
+    std::size_t countNodes(const ModelFolder &folder, bool countFolders) const
+    {
+        std::size_t count = countFolders ? 1 : folder.files.size();
+        for (const auto &child : folder.folders)
+            count += countNodes(*child.second, countFolders);
+        return count;
+    }
+
+    // model operations, each one returns false where the file manager has to report an error
+
+    bool changeDirectory(const std::string &destination, bool relative)
+    {
+        ModelFolder *folder = relative ? current_ : root_.get();
+        if (destination.empty() == false && destination[0] == '/')
+            return false;
+        if (destination.find("//") != std::string::npos)
+            return false;
+        std::size_t start = 0;
+        while (start < destination.size())
+        {
+            std::size_t end = std::min(destination.find('/', start), destination.size());
+            std::string component = destination.substr(start, end - start);
+            start = end + 1;
+            if (component == ".." && folder->parent != nullptr)
+                folder = folder->parent;
+            else if (component != ".." && folder->folders.count(component) != 0)
+                folder = folder->folders[component].get();
+            else
+                return false;
+        }
+        current_ = folder;
+        return true;
+    }
+
+    bool createFolder(const std::string &name)
+    {
+        if (validName(name) == false || current_->folders.count(name) != 0)
+            return false;
+        current_->folders[name] = std::make_unique<ModelFolder>(ModelFolder{childPath(*current_, name), current_, {}, {}});
+        return true;
+    }
+
+    bool createFile(const std::string &name, const std::string &content)
+    {
+        if (validName(name) == false || current_->files.count(name) != 0)
+            return false;
+        current_->files[name] = content;
+        return true;
+    }
+
+    bool updateFile(const std::string &name, const std::string &content)
+    {
+        if (validName(name) == false || current_->files.count(name) == 0)
+            return false;
+        current_->files[name] = content;
+        return true;
+    }
+
+    bool deleteFolder(const std::string &name)
+    {
+        if (validName(name) == false || current_->folders.count(name) == 0)
+            return false;
+        current_->folders.erase(name);
+        return true;
+    }
+
+    bool deleteFile(const std::string &name)
+    {
+        return validName(name) && current_->files.erase(name) != 0;
+    }
+
+    /**
+     * @brief prints a file the way File::printContents does
+     */
+    std::string renderFile(const std::string &name) const
+    {
+        const std::string &content = current_->files.at(name);
+        return "Metadata: Full Path: " + childPath(*current_, name) + ", File Size: " + std::to_string(content.size()) +
+               ", File Extension: " + extensionOf(name) + "\nContents: " + content + "\n";
+    }
+
+    /**
+     * @brief writes the NDJSON lines the file manager exports for the subtree of folder
+     */
+    void renderNdjson(const ModelFolder &folder, OutputSink &out) const
+    {
+        JsonWriter json{out};
+        json.beginObject()
+            .field("type", "folder")
+            .field("path", folder.path)
+            .field("folders", folder.folders.size())
+            .field("files", folder.files.size())
+            .endObject();
+        out.put('\n');
+        for (const auto &file : folder.files)
+        {
+            json.beginObject()
+                .field("type", "file")
+                .field("name", file.first)
+                .field("path", childPath(folder, file.first))
+                .field("size", file.second.size())
+                .field("extension", extensionOf(file.first))
+                .endObject();
+            out.put('\n');
+        }
+        for (const auto &child : folder.folders)
+            renderNdjson(*child.second, out);
+    }
+
+    static std::vector<std::string> sortedLines(const std::string &text)
+    {
+        std::vector<std::string> lines;
+        std::size_t start = 0;
+        while (start < text.size())
+        {
+            std::size_t end = std::min(text.find('\n', start), text.size());
+            lines.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+
+    /**
+     * @brief splits a "Folders: a, b, " listing line into its sorted names
+     */
+    static std::vector<std::string> listedNames(const std::string &line, std::string_view prefix)
+    {
+        if (line.compare(0, prefix.size(), prefix) != 0)
+            throw std::runtime_error("Listing line \"" + line + "\" doesn't start with " + std::string{prefix});
+        std::vector<std::string> names;
+        std::size_t start = prefix.size();
+        while (start < line.size())
+        {
+            std::size_t end = line.find(", ", start);
+            if (end == std::string::npos)
+                throw std::runtime_error("Listing line \"" + line + "\" isn't terminated by a separator");
+            names.push_back(line.substr(start, end - start));
+            start = end + 2;
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    static void expectEqual(const std::string &what, const std::string &expected, const std::string &actual)
+    {
+        if (expected != actual)
+            throw std::runtime_error(what + " differs, expected \"" + expected + "\" but got \"" + actual + "\"");
+    }
+
+    /**
+     * @brief finds the folder at path, or its deepest ancestor that is still there
+     */
+    ModelFolder *resolve(const std::string &path)
+    {
+        ModelFolder *folder = root_.get();
+        std::size_t start = 1;
+        while (start < path.size())
+        {
+            std::size_t end = std::min(path.find('/', start), path.size());
+            auto child = folder->folders.find(path.substr(start, end - start));
+            if (child == folder->folders.end())
+                break;
+            folder = child->second.get();
+            start = end + 1;
+        }
+        return folder;
+    }
+
+    std::size_t takeErrorLines()
+    {
+        std::string printed = errors_.take();
+        return std::count(printed.begin(), printed.end(), '\n');
+    }
+
+    void checkCurrentFolder(Client &client)
+    {
+        FileManager &fileManager = *client.fileManager;
+        StringOutputSink &out = *client.out;
+        expectEqual("working directory", client.path, fileManager.getWorkingDirectory());
+        current_ = resolve(client.path);
+        if (current_->path != client.path)
+        {
+            // another client deleted the folder: the listing fails once and moves the client up
+            fileManager.printCurrentFolderContents();
+            expectEqual("listing of a deleted folder", "", out.take());
+            expectEqual("errors of listing a deleted folder", "1", std::to_string(takeErrorLines()));
+            client.path = current_->path;
+            expectEqual("working directory after its deletion", client.path, fileManager.getWorkingDirectory());
+        }
+        fileManager.printCurrentFolderContents();
+        std::vector<std::string> lines;
+        std::string listing = out.take();
+        std::size_t start = 0;
+        while (start < listing.size())
+        {
+            std::size_t end = std::min(listing.find('\n', start), listing.size());
+            lines.push_back(listing.substr(start, end - start));
+            start = end + 1;
+        }
+        if (lines.size() != 3)
+            throw std::runtime_error("Listing has " + std::to_string(lines.size()) + " lines instead of 3: \"" + listing + "\"");
+        expectEqual("listing metadata",
+                    "Metadata: Full Path: " + current_->path + ", No. of folders: " + std::to_string(current_->folders.size()) +
+                        ", No. of files: " + std::to_string(current_->files.size()),
+                    lines[0]);
+
+        std::vector<std::string> folders;
+        if (current_->parent != nullptr)
+            folders.push_back("..");
+        for (const auto &folder : current_->folders)
+            folders.push_back(folder.first);
+        std::sort(folders.begin(), folders.end());
+        if (listedNames(lines[1], "Folders: ") != folders)
+            throw std::runtime_error("Listed folders differ: \"" + lines[1] + "\"");
+        std::vector<std::string> files;
+        for (const auto &file : current_->files)
+            files.push_back(file.first);
+        if (listedNames(lines[2], "Files: ") != files)
+            throw std::runtime_error("Listed files differ: \"" + lines[2] + "\"");
+    }
+
+    /**
+     * @brief compares the whole tree, the memory accounting against a full walk, and the node counters
+     * @param checker a file manager parked at the root folder
+     */
+    void checkWholeTree(FileManager &checker, StringOutputSink &out)
+    {
+        checker.exportCurrentFolderNdjson(true);
+        std::vector<std::string> actual = sortedLines(out.take());
+        StringOutputSink expectedOut;
+        renderNdjson(*root_, expectedOut);
+        std::vector<std::string> expected = sortedLines(expectedOut.take());
+        if (actual != expected)
+        {
+            auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin(), actual.end());
+            throw std::runtime_error("Tree export differs (" + std::to_string(expected.size()) + " lines expected, " +
+                                     std::to_string(actual.size()) + " got), first difference: expected \"" +
+                                     (mismatch.first == expected.end() ? "" : *mismatch.first) + "\" got \"" +
+                                     (mismatch.second == actual.end() ? "" : *mismatch.second) + "\"");
+        }
+
+        // at the root the tracked usage of the storage and the walk of the root's subtree come first
+        checker.printMemoryReport();
+        std::string report = out.take();
+        std::size_t storageLine = report.find("storage: ");
+        std::size_t rootLine = report.find("of /: ");
+        if (storageLine == std::string::npos || rootLine == std::string::npos)
+            throw std::runtime_error("Memory report is missing lines: \"" + report + "\"");
+        std::string tracked = report.substr(storageLine + 9, report.find('\n', storageLine) - storageLine - 9);
+        std::string walked = report.substr(rootLine + 6, report.find('\n', rootLine) - rootLine - 6);
+        expectEqual("tracked memory usage", walked, tracked);
+
+        if constexpr (Instrumentation::enabled)
+        {
+            MetricsRegistry &metrics = MetricsRegistry::instance();
+            std::uint64_t folders = metrics.counterValue(Counter::FoldersCreated) - metrics.counterValue(Counter::FoldersDestroyed);
+            std::uint64_t files = metrics.counterValue(Counter::FilesCreated) - metrics.counterValue(Counter::FilesDestroyed);
+            expectEqual("live folder count", std::to_string(countNodes(*root_, true)), std::to_string(folders));
+            expectEqual("live file count", std::to_string(countNodes(*root_, false)), std::to_string(files));
+        }
+    }
+
+    std::string pickDestination(bool &relative, const std::string &clientPath)
+    {
+        relative = chance(0.6);
+        switch (pickIndex(6))
+        {
+        case 0:
+            return "..";
+        case 1:
+        {
+            // an existing folder, so the walk actually gets somewhere
+            std::vector<ModelFolder *> folders;
+            collectFolders(*root_, folders);
+            ModelFolder *folder = folders[pickIndex(folders.size())];
+            relative = false;
+            return folder->path == "/" ? "" : folder->path.substr(1);
+        }
+        case 2:
+            return current_->folders.empty() ? pickName() : std::next(current_->folders.begin(), pickIndex(current_->folders.size()))->first;
+        case 3:
+            return clientPath;
+        case 4:
+        {
+            static const char *const malformed[] = {"", "/", "a//b", "/a", "a/", "../a", "a/..", "../../b"};
+            return malformed[pickIndex(std::size(malformed))];
+        }
+        default:
+            return pickName() + "/" + pickName();
+        }
+    }
+
+    std::string pickFileName()
+    {
+        if (current_->files.empty() == false && chance(0.7))
+            return std::next(current_->files.begin(), pickIndex(current_->files.size()))->first;
+        return pickName();
+    }
+
+    std::string pickFolderName()
+    {
+        if (current_->folders.empty() == false && chance(0.5))
+            return std::next(current_->folders.begin(), pickIndex(current_->folders.size()))->first;
+        return pickName();
+    }
+
+    /**
+     * @brief applies one random operation of a client to the model and to its file manager
+     * and checks the results that are specific to it
+     */
+    void step(std::size_t clientIndex)
+    {
+        Client &client = clients_[clientIndex];
+        FileManager &fileManager = *client.fileManager;
+        StringOutputSink &out = *client.out;
+        std::string description = "client " + std::to_string(clientIndex) + ": ";
+        auto expectError = [this](bool succeeded)
+        { expectedErrors_ += succeeded ? 0 : 1; };
+        // a client whose folder got deleted fails its next operation and moves to the closest ancestor
+        current_ = resolve(client.path);
+        bool deleted = current_->path != client.path;
+        auto applies = [&]()
+        {
+            if (deleted == false)
+                return true;
+            expectError(false);
+            client.path = current_->path;
+            deleted = false;
+            return false;
+        };
+
+        switch (pickIndex(19))
+        {
+        case 0:
+        case 1:
+        {
+            bool relative;
+            std::string destination = pickDestination(relative, client.path);
+            recentSteps_.push_back(description + "changeDirectory \"" + destination + "\" " + (relative ? "relative" : "absolute"));
+            // going where it already is is a no-op, absolute paths don't care about the current folder
+            if (destination == client.path)
+                ;
+            else if (relative == false)
+            {
+                bool succeeded = changeDirectory(destination, false);
+                expectError(succeeded);
+                deleted = deleted && succeeded == false;
+            }
+            else if (applies())
+                expectError(changeDirectory(destination, true));
+            fileManager.changeDirectory(destination, relative);
+            break;
+        }
+        case 2:
+        {
+            std::string name = pickName();
+            recentSteps_.push_back(description + "createFolder \"" + name + "\"");
+            if (applies())
+                expectError(createFolder(name));
+            fileManager.createFolder(name);
+            break;
+        }
+        case 3:
+        {
+            std::string name = pickName();
+            std::string content = pickContent();
+            recentSteps_.push_back(description + "createFile \"" + name + "\"");
+            if (applies())
+                expectError(createFile(name, content));
+            fileManager.createFile(name, content);
+            break;
+        }
+        case 4:
+        {
+            std::string name = pickFileName();
+            std::string content = pickContent();
+            recentSteps_.push_back(description + "updateFile \"" + name + "\"");
+            if (applies())
+                expectError(updateFile(name, content));
+            fileManager.updateFile(name, content);
+            break;
+        }
+        case 5:
+        {
+            std::string name = pickFolderName();
+            recentSteps_.push_back(description + "deleteFolder \"" + name + "\"");
+            if (applies())
+                expectError(deleteFolder(name));
+            fileManager.deleteFolder(name);
+            break;
+        }
+        case 6:
+        {
+            std::string name = pickFileName();
+            recentSteps_.push_back(description + "deleteFile \"" + name + "\"");
+            if (applies())
+                expectError(deleteFile(name));
+            fileManager.deleteFile(name);
+            break;
+        }
+        case 7:
+        {
+            std::string name = pickFileName();
+            recentSteps_.push_back(description + "printFileContents \"" + name + "\"");
+            std::string expected;
+            if (applies() == false)
+                ;
+            else if (validName(name) && current_->files.count(name) != 0)
+                expected = renderFile(name);
+            else
+                expectError(false);
+            fileManager.printFileContents(name);
+            expectEqual("printed file", expected, out.take());
+            break;
+        }
+        case 8:
+        {
+            // duplicates inside one batch are likely with a pool this small
+            std::vector<std::string> names(1 + pickIndex(4));
+            std::size_t created = 0;
+            for (std::string &name : names)
+                name = pickName();
+            recentSteps_.push_back(description + "createFolders of " + std::to_string(names.size()));
+            if (applies())
+            {
+                for (const std::string &name : names)
+                {
+                    bool succeeded = createFolder(name);
+                    created += succeeded ? 1 : 0;
+                    expectError(succeeded);
+                }
+            }
+            expectEqual("folders created by createFolders", std::to_string(created), std::to_string(fileManager.createFolders(std::move(names))));
+            break;
+        }
+        case 9:
+        {
+            std::string from = chance(0.2) ? "" : pickName();
+            std::string to = chance(0.3) ? "" : pickName();
+            recentSteps_.push_back(description + "printCurrentFolderRange \"" + from + "\" \"" + to + "\"");
+            auto listRange = [&](const auto &children)
+            {
+                std::string names;
+                for (auto child = children.lower_bound(from); child != children.end() && (to.empty() || child->first < to); ++child)
+                    names += child->first + ", ";
+                return names;
+            };
+            std::string expected;
+            if (applies())
+                expected = "Folders: " + listRange(current_->folders) + "\nFiles: " + listRange(current_->files) + "\n";
+            fileManager.printCurrentFolderRange(from, to);
+            expectEqual("printed range", expected, out.take());
+            break;
+        }
+        case 11:
+        {
+            std::string prefix = pickName();
+            prefix.resize(pickIndex(prefix.size() + 1));
+            recentSteps_.push_back(description + "printCompletions \"" + prefix + "\"");
+            std::string expected;
+            if (applies())
+            {
+                std::vector<std::pair<std::string, bool>> names;
+                for (const auto &folder : current_->folders)
+                    names.push_back({folder.first, false});
+                for (const auto &file : current_->files)
+                    names.push_back({file.first, true});
+                std::sort(names.begin(), names.end());
+                expected = "Completions: ";
+                for (const auto &[name, isFile] : names)
+                {
+                    if (name.compare(0, prefix.size(), prefix) == 0)
+                        expected += name + (isFile ? ", " : "/, ");
+                }
+                expected += "\n";
+            }
+            fileManager.printCompletions(prefix);
+            expectEqual("printed completions", expected, out.take());
+            break;
+        }
+        case 10:
+        {
+            // modification times can tie, so the fuzzer only checks the orders it can predict
+            ListingOrder order = chance(0.5) ? ListingOrder::Name : ListingOrder::Size;
+            std::size_t limit = pickIndex(8);
+            bool descending = chance(0.5);
+            recentSteps_.push_back(description + "printCurrentFolderSorted by " + (order == ListingOrder::Name ? "name" : "size") +
+                                   ", limit " + std::to_string(limit) + (descending ? " descending" : ""));
+            std::string expected;
+            if (applies())
+            {
+                std::vector<std::string> folders;
+                for (const auto &folder : current_->folders)
+                {
+                    if (order == ListingOrder::Name)
+                        folders.push_back(folder.first);
+                }
+                if (descending)
+                    std::reverse(folders.begin(), folders.end());
+                folders.resize(std::min(folders.size(), limit));
+                std::vector<std::pair<std::string, std::size_t>> files;
+                for (const auto &file : current_->files)
+                    files.push_back({file.first, file.second.size()});
+                std::stable_sort(files.begin(), files.end(), [&](const auto &lhs, const auto &rhs)
+                                 {
+                                     if (order == ListingOrder::Name)
+                                         return descending ? rhs.first < lhs.first : lhs.first < rhs.first;
+                                     return descending ? rhs.second < lhs.second : lhs.second < rhs.second; });
+                files.resize(std::min(files.size(), limit - folders.size()));
+                expected = "Folders: ";
+                for (const std::string &folder : folders)
+                    expected += folder + ", ";
+                expected += "\nFiles: ";
+                for (const auto &file : files)
+                    expected += file.first + ", ";
+                expected += "\n";
+            }
+            fileManager.printCurrentFolderSorted(order, limit, descending);
+            expectEqual("printed sorted listing", expected, out.take());
+            break;
+        }
+        case 12:
+        {
+            std::string name = pickName();
+            recentSteps_.push_back(description + "printFindResults \"" + name + "\"");
+            std::string expected;
+            if (applies())
+            {
+                if (validName(name) == false)
+                    expectError(false);
+                else
+                {
+                    std::vector<std::pair<std::string, bool>> found;
+                    std::vector<const ModelFolder *> pending{current_};
+                    while (pending.empty() == false)
+                    {
+                        const ModelFolder *folder = pending.back();
+                        pending.pop_back();
+                        if (folder->folders.count(name) != 0)
+                            found.push_back({childPath(*folder, name), false});
+                        if (folder->files.count(name) != 0)
+                            found.push_back({childPath(*folder, name), true});
+                        for (const auto &child : folder->folders)
+                            pending.push_back(child.second.get());
+                    }
+                    std::sort(found.begin(), found.end());
+                    expected = "Found: ";
+                    for (const auto &[path, isFile] : found)
+                        expected += path + (isFile ? ", " : "/, ");
+                    expected += "\n";
+                }
+            }
+            fileManager.printFindResults(name);
+            expectEqual("printed find results", expected, out.take());
+            break;
+        }
+        case 13:
+        {
+            std::string extension = extensionOf(pickName());
+            recentSteps_.push_back(description + "printFindByExtension \"" + extension + "\"");
+            std::string expected;
+            if (applies())
+            {
+                std::vector<std::string> found;
+                std::vector<const ModelFolder *> pending{current_};
+                while (pending.empty() == false)
+                {
+                    const ModelFolder *folder = pending.back();
+                    pending.pop_back();
+                    for (const auto &file : folder->files)
+                    {
+                        if (extensionOf(file.first) == extension)
+                            found.push_back(childPath(*folder, file.first));
+                    }
+                    for (const auto &child : folder->folders)
+                        pending.push_back(child.second.get());
+                }
+                std::sort(found.begin(), found.end());
+                expected = "Found: ";
+                for (const std::string &path : found)
+                    expected += path + ", ";
+                expected += "\n";
+            }
+            fileManager.printFindByExtension(extension);
+            expectEqual("printed extension search", expected, out.take());
+            break;
+        }
+        case 14:
+        {
+            std::size_t limit = pickIndex(6);
+            recentSteps_.push_back(description + "printLargestFiles " + std::to_string(limit));
+            std::string expected;
+            if (applies())
+            {
+                // largest first and then by path
+                std::vector<std::pair<std::size_t, std::string>> files;
+                std::vector<const ModelFolder *> pending{current_};
+                while (pending.empty() == false)
+                {
+                    const ModelFolder *folder = pending.back();
+                    pending.pop_back();
+                    for (const auto &file : folder->files)
+                        files.push_back({std::numeric_limits<std::size_t>::max() - file.second.size(), childPath(*folder, file.first)});
+                    for (const auto &child : folder->folders)
+                        pending.push_back(child.second.get());
+                }
+                std::sort(files.begin(), files.end());
+                files.resize(std::min(files.size(), limit));
+                expected = "Largest files: ";
+                for (const auto &[inverseSize, path] : files)
+                    expected += path + " (" + std::to_string(std::numeric_limits<std::size_t>::max() - inverseSize) + " bytes), ";
+                expected += "\n";
+            }
+            fileManager.printLargestFiles(limit);
+            expectEqual("printed largest files", expected, out.take());
+            break;
+        }
+        case 15:
+        {
+            // modification times can't be predicted, so the time range is either everything or nothing
+            FileQuery query;
+            query.minSize = pickIndex(12);
+            if (chance(0.5))
+                query.maxSize = pickIndex(20);
+            std::size_t timeRange = pickIndex(3);
+            auto now = std::chrono::system_clock::now();
+            if (timeRange == 1)
+                query.modifiedBefore = now + std::chrono::hours{1};
+            else if (timeRange == 2)
+                query.modifiedFrom = now + std::chrono::hours{1};
+            std::size_t prefix = pickIndex(3);
+            if (prefix == 1)
+                query.pathPrefix = current_->path;
+            else if (prefix == 2)
+                query.pathPrefix = "/" + pickName().substr(0, 1);
+            recentSteps_.push_back(description + "printMatchingFiles sizes " + std::to_string(query.minSize) + " to " +
+                                   std::to_string(query.maxSize) + ", time range " + std::to_string(timeRange) +
+                                   ", prefix \"" + query.pathPrefix + "\"");
+            std::vector<std::pair<std::string, std::size_t>> files;
+            std::vector<const ModelFolder *> pending{root_.get()};
+            while (pending.empty() == false && timeRange != 2)
+            {
+                const ModelFolder *folder = pending.back();
+                pending.pop_back();
+                for (const auto &file : folder->files)
+                {
+                    std::string path = childPath(*folder, file.first);
+                    if (file.second.size() >= query.minSize && file.second.size() <= query.maxSize &&
+                        path.compare(0, query.pathPrefix.size(), query.pathPrefix) == 0)
+                        files.push_back({path, file.second.size()});
+                }
+                for (const auto &child : folder->folders)
+                    pending.push_back(child.second.get());
+            }
+            std::sort(files.begin(), files.end());
+            std::string expected = "Matching files: ";
+            for (const auto &[path, size] : files)
+                expected += path + " (" + std::to_string(size) + " bytes), ";
+            expected += "\n";
+            fileManager.printMatchingFiles(query);
+            expectEqual("printed matching files", expected, out.take());
+            break;
+        }
+        case 16:
+        {
+            recentSteps_.push_back(description + "printDuplicates");
+            std::string expected;
+            if (applies())
+            {
+                std::map<std::string, std::vector<std::string>> pathsByContent;
+                std::vector<const ModelFolder *> pending{current_};
+                while (pending.empty() == false)
+                {
+                    const ModelFolder *folder = pending.back();
+                    pending.pop_back();
+                    for (const auto &file : folder->files)
+                    {
+                        if (file.second.empty() == false)
+                            pathsByContent[file.second].push_back(childPath(*folder, file.first));
+                    }
+                    for (const auto &child : folder->folders)
+                        pending.push_back(child.second.get());
+                }
+                // largest first and then by the first path
+                std::vector<std::pair<std::size_t, std::vector<std::string>>> sets;
+                std::size_t reclaimable = 0;
+                for (auto &[content, paths] : pathsByContent)
+                {
+                    if (paths.size() < 2)
+                        continue;
+                    std::sort(paths.begin(), paths.end());
+                    sets.push_back({std::numeric_limits<std::size_t>::max() - content.size(), paths});
+                    reclaimable += (paths.size() - 1) * content.size();
+                }
+                std::sort(sets.begin(), sets.end());
+                for (const auto &[inverseSize, paths] : sets)
+                {
+                    expected += "Duplicates of " + std::to_string(std::numeric_limits<std::size_t>::max() - inverseSize) + " bytes: ";
+                    for (const std::string &path : paths)
+                        expected += path + ", ";
+                    expected += "\n";
+                }
+                expected += "Reclaimable bytes: " + std::to_string(reclaimable) + "\n";
+            }
+            fileManager.printDuplicates();
+            expectEqual("printed duplicates", expected, out.take());
+            break;
+        }
+        case 17:
+        {
+            std::size_t maxDepth = pickIndex(4);
+            recentSteps_.push_back(description + "printDiskUsage " + std::to_string(maxDepth));
+            std::string expected;
+            if (applies())
+            {
+                struct Totals
+                {
+                    std::size_t bytes = 0, files = 0, folders = 0;
+                };
+                std::function<Totals(const ModelFolder &, std::size_t, std::string &)> visit;
+                visit = [&](const ModelFolder &folder, std::size_t depth, std::string &lines)
+                {
+                    Totals totals;
+                    for (const auto &file : folder.files)
+                        totals.bytes += file.second.size();
+                    totals.files = folder.files.size();
+                    // largest first and then by path
+                    std::vector<std::tuple<std::size_t, std::string, std::string>> children;
+                    for (const auto &child : folder.folders)
+                    {
+                        std::string childLines;
+                        Totals childTotals = visit(*child.second, depth + 1, childLines);
+                        totals.bytes += childTotals.bytes;
+                        totals.files += childTotals.files;
+                        totals.folders += childTotals.folders + 1;
+                        children.emplace_back(std::numeric_limits<std::size_t>::max() - childTotals.bytes, child.second->path, childLines);
+                    }
+                    std::sort(children.begin(), children.end());
+                    lines = std::string(2 * depth, ' ') + std::to_string(totals.bytes) + " bytes, " + std::to_string(totals.files) + " files, " +
+                            std::to_string(totals.folders) + " folders: " + folder.path + "\n";
+                    if (depth < maxDepth)
+                    {
+                        for (const auto &child : children)
+                            lines += std::get<2>(child);
+                    }
+                    return totals;
+                };
+                visit(*current_, 0, expected);
+            }
+            fileManager.printDiskUsage(maxDepth);
+            expectEqual("printed disk usage", expected, out.take());
+            break;
+        }
+        default:
+        {
+            std::vector<std::pair<std::string, std::string>> files(1 + pickIndex(4));
+            std::size_t created = 0;
+            for (auto &[name, content] : files)
+            {
+                name = pickName();
+                content = pickContent();
+            }
+            recentSteps_.push_back(description + "createFiles of " + std::to_string(files.size()));
+            if (applies())
+            {
+                for (const auto &[name, content] : files)
+                {
+                    bool succeeded = createFile(name, content);
+                    created += succeeded ? 1 : 0;
+                    expectError(succeeded);
+                }
+            }
+            expectEqual("files created by createFiles", std::to_string(created), std::to_string(fileManager.createFiles(std::move(files))));
+            break;
+        }
+        }
+        if (deleted == false)
+            client.path = current_->path;
+        if (recentSteps_.size() > kRecentSteps)
+            recentSteps_.pop_front();
+    }
+
+    /**
+     * @brief one scheduled step of a client: the operation, its errors and the client's listing
+     */
+    void stepAndCheck(std::size_t clientIndex)
+    {
+        expectedErrors_ = 0;
+        step(clientIndex);
+        std::size_t errorLines = takeErrorLines();
+        if (errorLines != expectedErrors_)
+            throw std::runtime_error("Expected " + std::to_string(expectedErrors_) + " errors but " +
+                                     std::to_string(errorLines) + " were reported");
+        checkCurrentFolder(clients_[clientIndex]);
+    }
+
+    /**
+     * @brief runs one seed to the end or to the first mismatch
+     * @throws std::runtime_error describing the first mismatch
+     */
+    void runOne(std::uint64_t seed, std::size_t &stepsDone)
+    {
+        random_.seed(seed);
+        root_ = std::make_unique<ModelFolder>(ModelFolder{"/", nullptr, {}, {}});
+        current_ = root_.get();
+        recentSteps_.clear();
+        errors_.take();
+
+        try
+        {
+            NullOutputSink quiet;
+            FileStorage storage{&quiet};
+            clients_.clear();
+            for (std::size_t i = 0; i < clientCount_; i++)
+            {
+                clients_.push_back({std::make_unique<StringOutputSink>(), std::make_unique<FileManager>(&storage), "/"});
+                clients_.back().fileManager->setOutputSink(clients_.back().out.get());
+                clients_.back().fileManager->setErrorSink(&errors_);
+            }
+            StringOutputSink checkerOut;
+            FileManager checker{&storage};
+            checker.setOutputSink(&checkerOut);
+            checker.setErrorSink(&errors_);
+            {
+                DeterministicScheduler scheduler{clientCount_, seed, switchProbability_, [this](std::size_t client)
+                                                 { stepAndCheck(client); }};
+                for (stepsDone = 0; stepsDone < steps_; stepsDone++)
+                {
+                    scheduler.runNext();
+                    if (stepsDone % checkEvery_ == checkEvery_ - 1)
+                        checkWholeTree(checker, checkerOut);
+                }
+            }
+            checkWholeTree(checker, checkerOut);
+            clients_.clear();
+        }
+        catch (...)
+        {
+            clients_.clear();
+            throw;
+        }
+    }
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--seed")
+                seed_ = std::stoull(value);
+            else if (option == "--runs")
+                runs_ = std::stoull(value);
+            else if (option == "--steps")
+                steps_ = std::stoull(value);
+            else if (option == "--check-every")
+                checkEvery_ = std::stoull(value);
+            else if (option == "--clients")
+                clientCount_ = std::stoull(value);
+            else if (option == "--switch-probability")
+                switchProbability_ = std::stod(value);
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+        if (checkEvery_ == 0 || clientCount_ == 0)
+            throw std::runtime_error("--check-every and --clients have to be at least 1");
+    }
+
+    /**
+     * @return whether every run matched the model
+     */
+    bool run(OutputSink &out)
+    {
+        JsonWriter json{out};
+        auto start = std::chrono::steady_clock::now();
+        std::size_t totalSteps = 0;
+        for (std::size_t i = 0; i < runs_; i++)
+        {
+            std::size_t stepsDone = 0;
+            try
+            {
+                runOne(seed_ + i, stepsDone);
+                totalSteps += stepsDone;
+            }
+            catch (const std::exception &e)
+            {
+                json.beginObject().field("result", "mismatch").field("seed", seed_ + i).field("step", stepsDone).field("error", e.what());
+                json.key("recentSteps").beginArray();
+                for (const std::string &recentStep : recentSteps_)
+                    json.value(recentStep);
+                json.endArray().endObject();
+                out.put('\n');
+                return false;
+            }
+        }
+        json.beginObject()
+            .field("result", "ok")
+            .field("clients", clientCount_)
+            .field("runs", runs_)
+            .field("steps", totalSteps)
+            .field("seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+            .endObject();
+        out.put('\n');
+        return true;
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-fuzz`, exits with 1 on the first mismatch
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        DifferentialFuzzer fuzzer;
+        try
+        {
+            fuzzer.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing fuzz options: " << e.what() << "\n"
+                      << "Usage: fm-fuzz [--seed N] [--runs N] [--steps N] [--check-every N] [--clients N]"
+                      << " [--switch-probability X]" << std::endl;
+            return 1;
+        }
+
+        FdOutputSink out{STDOUT_FILENO};
+        return fuzzer.run(out) ? 0 : 1;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return DifferentialFuzzer::main(argc - 1, argv + 1);
+}
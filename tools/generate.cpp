@@ -0,0 +1,362 @@
+/**
+ * @file generate.cpp
+ * @brief Builds synthetic trees from log-normal distributions of folder contents and file sizes, built as fm-generate
+ */
+
+#include "file_manager.hpp"
+
+#include <cmath>
+#include <random>
+
+/**
+ * @class TreeGenerator
+ * @brief Builds large synthetic trees from distribution parameters through the bulk creation paths,
+ * run with `fm-generate [options]`. The node budget is split evenly between the child folders
+ * of every folder, so the tree comes out balanced and hits the requested node count exactly
+ * unless the depth limit cuts it short.
+ */
+class TreeGenerator
+{
+public:
+    struct Parameters
+    {
+        std::uint64_t nodes = 100000;
+        // counts per folder are log-normal around these means
+        double filesPerFolder = 12;
+        double foldersPerFolder = 3;
+        double countSigma = 1.0;
+        std::size_t maxDepth = 12;
+        // file sizes are log-normal around the median, then multiplied by sizeScale
+        double fileSizeMedian = 4096;
+        double fileSizeSigma = 1.5;
+        double sizeScale = 1.0;
+        std::size_t nameLengthMin = 4;
+        std::size_t nameLengthMax = 16;
+        std::vector<std::pair<std::string, double>> extensions{{"cpp", 35}, {"h", 30}, {"py", 10}, {"md", 5}, {"json", 5}, {"txt", 5}, {"", 10}};
+        std::uint64_t seed = 1;
+    };
+
+    struct Summary
+    {
+        std::uint64_t folders = 0;
+        std::uint64_t files = 0;
+        std::uint64_t contentBytes = 0;
+        std::size_t maxDepth = 0;
+    };
+
+    /**
+     * @brief applies a named set of parameters measured on real trees
+     * @throws std::runtime_error if the preset is unknown
+     */
+    static void applyPreset(Parameters &parameters, std::string_view preset)
+    {
+        if (preset == "source-tree")
+        {
+            parameters.filesPerFolder = 12;
+            parameters.foldersPerFolder = 3;
+            parameters.maxDepth = 12;
+            parameters.fileSizeMedian = 4096;
+            parameters.fileSizeSigma = 1.5;
+            parameters.nameLengthMin = 4;
+            parameters.nameLengthMax = 16;
+            parameters.extensions = {{"cpp", 35}, {"h", 30}, {"py", 10}, {"md", 5}, {"json", 5}, {"txt", 5}, {"", 10}};
+        }
+        else if (preset == "photo-archive")
+        {
+            // year/month/event folders holding hundreds of large pictures each
+            parameters.filesPerFolder = 250;
+            parameters.foldersPerFolder = 10;
+            parameters.maxDepth = 3;
+            parameters.fileSizeMedian = 3 * 1024 * 1024;
+            parameters.fileSizeSigma = 0.5;
+            parameters.nameLengthMin = 8;
+            parameters.nameLengthMax = 12;
+            parameters.extensions = {{"jpg", 80}, {"cr2", 12}, {"mp4", 5}, {"xmp", 3}};
+        }
+        else
+            throw std::runtime_error("Unknown preset " + std::string{preset});
+    }
+
+    TreeGenerator(FileManager &fileManager, const Parameters &parameters)
+        : fileManager_{fileManager}, parameters_{parameters}, random_{parameters.seed},
+          pickExtension_{extensionPicker(parameters)},
+          pickNameLength_{parameters.nameLengthMin, std::max(parameters.nameLengthMin, parameters.nameLengthMax)},
+          fileSize_{std::log(parameters.fileSizeMedian), parameters.fileSizeSigma} {}
+
+    /**
+     * @brief generates the tree under the current folder of the file manager,
+     * which is back in that folder once this returns
+     */
+    Summary generate()
+    {
+        struct Pending
+        {
+            std::string path;
+            std::size_t depth;
+            std::uint64_t budget;
+        };
+        Summary summary;
+        std::string basePath = fileManager_.getWorkingDirectory();
+        std::vector<Pending> pending{{"", 0, parameters_.nodes}};
+        std::string content;
+
+        while (pending.empty() == false)
+        {
+            Pending folder = std::move(pending.back());
+            pending.pop_back();
+            if (folder.path.empty() == false)
+                fileManager_.changeDirectory(folder.path, true);
+            summary.maxDepth = std::max(summary.maxDepth, folder.depth);
+
+            std::uint64_t budget = folder.budget;
+            std::uint64_t files = std::min<std::uint64_t>(sampleCount(parameters_.filesPerFolder), budget);
+            // the deepest folders take whatever budget is left, there's nowhere else to put it
+            if (folder.depth >= parameters_.maxDepth)
+                files = budget;
+            budget -= files;
+            std::uint64_t folders = 0;
+            if (budget > 0)
+            {
+                // enough child folders that their subtrees can take the budget without outgrowing the depth limit
+                double capacity = subtreeCapacity(parameters_.maxDepth - folder.depth - 1);
+                std::uint64_t needed = static_cast<std::uint64_t>(std::ceil(budget / capacity));
+                folders = std::clamp<std::uint64_t>(std::max(sampleCount(parameters_.foldersPerFolder), needed), 1, budget);
+            }
+            budget -= folders;
+
+            std::vector<std::pair<std::string, std::string>> newFiles;
+            newFiles.reserve(files);
+            for (std::uint64_t i = 0; i < files; i++)
+            {
+                std::size_t size = static_cast<std::size_t>(fileSize_(random_) * parameters_.sizeScale);
+                summary.contentBytes += size;
+                newFiles.emplace_back(sampleName(i, true), std::string(size, 'x'));
+            }
+            summary.files += fileManager_.createFiles(std::move(newFiles));
+
+            std::vector<std::string> newFolders;
+            newFolders.reserve(folders);
+            for (std::uint64_t i = 0; i < folders; i++)
+                newFolders.push_back(sampleName(i, false));
+            summary.folders += fileManager_.createFolders(newFolders);
+            for (std::uint64_t i = 0; i < folders; i++)
+            {
+                std::uint64_t childBudget = budget / folders + (i < budget % folders ? 1 : 0);
+                pending.push_back({folder.path.empty() ? newFolders[i] : folder.path + "/" + newFolders[i], folder.depth + 1, childBudget});
+            }
+            // paths on the stack are relative to the base folder, go back there before the next one
+            if (folder.path.empty() == false)
+                fileManager_.changeDirectory(basePath == "/" ? "" : basePath.substr(1), false);
+        }
+        return summary;
+    }
+
+private:
+    FileManager &fileManager_;
+    const Parameters &parameters_;
+    std::mt19937_64 random_;
+    std::discrete_distribution<std::size_t> pickExtension_;
+    std::uniform_int_distribution<std::size_t> pickNameLength_;
+    std::lognormal_distribution<double> fileSize_;
+
+    static std::discrete_distribution<std::size_t> extensionPicker(const Parameters &parameters)
+    {
+        std::vector<double> weights;
+        for (const auto &extension : parameters.extensions)
+            weights.push_back(extension.second);
+        return {weights.begin(), weights.end()};
+    }
+
+    /**
+     * @brief gets the expected node count of a subtree whose folders all have the mean
+     * number of files and child folders, levels below its root folder
+     */
+    double subtreeCapacity(std::size_t levels) const
+    {
+        double folders = 0;
+        double levelFolders = 1;
+        for (std::size_t level = 0; level <= levels && folders < 1e18; level++)
+        {
+            folders += levelFolders;
+            levelFolders *= std::max(1.0, parameters_.foldersPerFolder);
+        }
+        return folders * (1 + parameters_.filesPerFolder);
+    }
+
+    std::uint64_t sampleCount(double mean)
+    {
+        if (mean <= 0)
+            return 0;
+        double sigma = parameters_.countSigma;
+        std::lognormal_distribution<double> count{std::log(mean) - sigma * sigma / 2, sigma};
+        return static_cast<std::uint64_t>(count(random_) + 0.5);
+    }
+
+    /**
+     * @brief makes a random name, unique within its folder thanks to the index suffix
+     */
+    std::string sampleName(std::uint64_t index, bool isFile)
+    {
+        static constexpr char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_";
+        std::string name;
+        std::size_t length = pickNameLength_(random_);
+        std::uniform_int_distribution<std::size_t> pickChar{0, sizeof(alphabet) - 2};
+        for (std::size_t i = 0; i < length; i++)
+            name.push_back(alphabet[pickChar(random_)]);
+        name += "_" + std::to_string(index);
+        if (isFile && parameters_.extensions.empty() == false)
+        {
+            const std::string &extension = parameters_.extensions[pickExtension_(random_)].first;
+            if (extension.empty() == false)
+                name += "." + extension;
+        }
+        return name;
+    }
+
+    static double parseNumber(const std::string &value)
+    {
+        std::size_t parsed = 0;
+        double number = std::stod(value, &parsed);
+        if (parsed != value.size() || number < 0)
+            throw std::runtime_error("Expected a non-negative number, got \"" + value + "\"");
+        return number;
+    }
+
+    static std::vector<std::pair<std::string, double>> parseExtensions(const std::string &list)
+    {
+        std::vector<std::pair<std::string, double>> extensions;
+        std::size_t start = 0;
+        while (start < list.size())
+        {
+            std::size_t end = list.find(',', start);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string item = list.substr(start, end - start);
+            std::size_t equals = item.find('=');
+            if (equals == std::string::npos)
+                throw std::runtime_error("Expected extension=weight, got \"" + item + "\"");
+            extensions.emplace_back(item.substr(0, equals), parseNumber(item.substr(equals + 1)));
+            start = end + 1;
+        }
+        return extensions;
+    }
+
+public:
+    /**
+     * @brief reads generator options, presets are applied first so later options override them
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    static void parseOptions(Parameters &parameters, int argc, char *argv[])
+    {
+        for (int i = 0; i + 1 < argc; i += 2)
+        {
+            if (std::string_view{argv[i]} == "--preset")
+                applyPreset(parameters, argv[i + 1]);
+        }
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--preset")
+                continue;
+            else if (option == "--nodes")
+                parameters.nodes = static_cast<std::uint64_t>(parseNumber(value));
+            else if (option == "--files-per-folder")
+                parameters.filesPerFolder = parseNumber(value);
+            else if (option == "--folders-per-folder")
+                parameters.foldersPerFolder = parseNumber(value);
+            else if (option == "--count-sigma")
+                parameters.countSigma = parseNumber(value);
+            else if (option == "--max-depth")
+                parameters.maxDepth = static_cast<std::size_t>(parseNumber(value));
+            else if (option == "--file-size-median")
+                parameters.fileSizeMedian = parseNumber(value);
+            else if (option == "--file-size-sigma")
+                parameters.fileSizeSigma = parseNumber(value);
+            else if (option == "--size-scale")
+                parameters.sizeScale = parseNumber(value);
+            else if (option == "--name-length-min")
+                parameters.nameLengthMin = static_cast<std::size_t>(parseNumber(value));
+            else if (option == "--name-length-max")
+                parameters.nameLengthMax = static_cast<std::size_t>(parseNumber(value));
+            else if (option == "--extensions")
+                parameters.extensions = parseExtensions(value);
+            else if (option == "--seed")
+                parameters.seed = static_cast<std::uint64_t>(parseNumber(value));
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+    }
+
+    /**
+     * @brief entry point of `fm-generate`, prints a JSON summary
+     * and optionally the memory report or the whole tree as NDJSON
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        Parameters parameters;
+        bool printMemory = false;
+        bool exportTree = false;
+        std::vector<char *> options;
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (option == "--print-memory")
+                printMemory = true;
+            else if (option == "--export")
+                exportTree = true;
+            else
+                options.push_back(argv[i]);
+        }
+        try
+        {
+            parseOptions(parameters, options.size(), options.data());
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing generator options: " << e.what() << "\n"
+                      << "Usage: fm-generate [--preset source-tree|photo-archive] [--nodes N] [--files-per-folder X]"
+                      << " [--folders-per-folder X] [--count-sigma X] [--max-depth N] [--file-size-median BYTES]"
+                      << " [--file-size-sigma X] [--size-scale X] [--name-length-min N] [--name-length-max N]"
+                      << " [--extensions ext=weight,...] [--seed N] [--print-memory] [--export]" << std::endl;
+            return 1;
+        }
+
+        {
+            FdOutputSink out{STDOUT_FILENO};
+            NullOutputSink quiet;
+            FileStorage storage{&quiet};
+            FileManager fileManager{&storage};
+            fileManager.setOutputSink(&out);
+
+            auto start = std::chrono::steady_clock::now();
+            Summary summary = TreeGenerator{fileManager, parameters}.generate();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            JsonWriter json{out};
+            json.beginObject()
+                .field("folders", summary.folders)
+                .field("files", summary.files)
+                .field("contentBytes", summary.contentBytes)
+                .field("maxDepth", summary.maxDepth)
+                .field("seconds", seconds)
+                .field("nodesPerSecond", (summary.folders + summary.files) / seconds)
+                .endObject();
+            out.put('\n');
+            if (printMemory)
+                fileManager.printMemoryReport();
+            if (exportTree)
+                fileManager.exportCurrentFolderNdjson(true);
+            out.flush();
+        }
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return TreeGenerator::main(argc - 1, argv + 1);
+}
@@ -0,0 +1,275 @@
+/**
+ * @file index.cpp
+ * @brief Insert, lookup and range scan cost of the folder child tables, built as fm-index
+ */
+
+#include "file_manager.hpp"
+#include "tool_options.hpp"
+
+#include <random>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/**
+ * @class IndexBenchmark
+ * @brief Child table benchmark, run with `fm-index [options]`. Fills the hash map folders used to
+ * keep their children in, an IncrementalHashTable and a ChildIndex with the same names in random
+ * order, timing every insert on its own, so the pauses of the map doubling and rehashing
+ * everything show up in the tail percentiles. Lookups of every name and ordered scans of short
+ * name ranges are timed too; the hash tables have to filter and sort all of their names for
+ * a range, so they only get a few of them.
+ */
+class IndexBenchmark
+{
+private:
+    using Map = std::unordered_map<std::string, const std::string *>;
+    using HashTable = IncrementalHashTable<const std::string>;
+    using Index = ChildIndex<const std::string>;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t kMapScans = 10;
+
+    std::vector<std::size_t> entryCounts_{100000, 1000000};
+    std::size_t scans_{10000};
+    std::size_t scanLength_{100};
+    std::uint64_t seed_{1};
+
+    static std::uint64_t elapsedSince(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--entries")
+                entryCounts_ = parseSizes(value);
+            else if (option == "--scans")
+                scans_ = std::stoull(value);
+            else if (option == "--scan-length")
+                scanLength_ = std::stoull(value);
+            else if (option == "--seed")
+                seed_ = std::stoull(value);
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+        for (std::size_t entries : entryCounts_)
+        {
+            if (entries <= scanLength_)
+                throw std::runtime_error("Entry counts have to be larger than the scan length");
+        }
+        if (scans_ == 0 || scanLength_ == 0)
+            throw std::runtime_error("Scans and scan length have to be at least 1");
+    }
+
+    /**
+     * @brief hands the chunks of the table just destroyed back now, otherwise glibc consolidates
+     * them during the next table's first larger allocation and that insert takes the blame
+     */
+    static void releaseFreedMemory() noexcept
+    {
+#ifdef __GLIBC__
+        ::malloc_trim(0);
+#endif
+    }
+
+    static void writeLatencies(JsonWriter &json, const LatencyHistogram::Snapshot &inserts)
+    {
+        json.key("insertNs").beginObject()
+            .field("mean", static_cast<double>(inserts.sum) / inserts.totalCount)
+            .field("p50", inserts.valueAt(0.5))
+            .field("p99", inserts.valueAt(0.99))
+            .field("p999", inserts.valueAt(0.999))
+            .field("max", inserts.max)
+            .endObject();
+    }
+
+    /**
+     * @brief fills table with names, then looks every name up and scans ranges of it
+     * @param sorted the names in order, ranges start at random positions in it
+     * @throws std::runtime_error when a lookup or a scan comes back wrong
+     */
+    template <typename Insert, typename Find, typename Scan>
+    void measure(JsonWriter &json, std::string_view kind, const std::vector<std::string> &names,
+                 const std::vector<std::string> &sorted, std::size_t scans, Insert insert, Find find, Scan scan)
+    {
+        LatencyHistogram::Snapshot inserts;
+        auto start = Clock::now();
+        for (const std::string &name : names)
+        {
+            auto insertStart = Clock::now();
+            insert(name);
+            inserts.add(elapsedSince(insertStart));
+        }
+        std::uint64_t fillNs = elapsedSince(start);
+
+        start = Clock::now();
+        std::size_t found = 0;
+        for (auto name = sorted.rbegin(); name != sorted.rend(); ++name)
+            found += find(*name) ? 1 : 0;
+        std::uint64_t lookupNs = elapsedSince(start);
+        if (found != names.size())
+            throw std::runtime_error(std::string{kind} + " lost " + std::to_string(names.size() - found) + " names");
+
+        std::mt19937_64 random{seed_};
+        std::uniform_int_distribution<std::size_t> pickStart{0, sorted.size() - scanLength_ - 1};
+        start = Clock::now();
+        for (std::size_t i = 0; i < scans; i++)
+        {
+            std::size_t first = pickStart(random);
+            if (scan(sorted[first], sorted[first + scanLength_]) != scanLength_)
+                throw std::runtime_error(std::string{kind} + " scanned a range wrong");
+        }
+        std::uint64_t scanNs = elapsedSince(start);
+
+        json.beginObject().field("table", kind);
+        writeLatencies(json, inserts);
+        json.field("fillSeconds", fillNs / 1e9)
+            .field("lookupNs", static_cast<double>(lookupNs) / names.size())
+            .field("rangeScanNs", static_cast<double>(scanNs) / scans)
+            .endObject();
+    }
+
+    void run(OutputSink &out)
+    {
+        JsonWriter json{out};
+        json.beginObject();
+        json.key("context").beginObject()
+            .field("treeThreshold", std::size_t{FM_CHILD_INDEX_THRESHOLD})
+            .field("treeNodeCapacity", std::size_t{FM_BTREE_NODE_CAPACITY})
+            .field("scans", scans_)
+            .field("mapScans", kMapScans)
+            .field("scanLength", scanLength_)
+            .endObject();
+        json.key("results").beginArray();
+        for (std::size_t entries : entryCounts_)
+        {
+            std::vector<std::string> names;
+            names.reserve(entries);
+            for (std::size_t i = 0; i < entries; i++)
+                names.push_back("entry-" + std::to_string(1000000000 + i));
+            std::shuffle(names.begin(), names.end(), std::mt19937_64{seed_});
+            std::vector<std::string> sorted = names;
+            std::sort(sorted.begin(), sorted.end());
+
+            out.put('\n');
+            json.beginObject().field("entries", entries).key("tables").beginArray();
+            {
+                Map map;
+                measure(
+                    json, "unordered_map", names, sorted, std::min(scans_, kMapScans),
+                    [&map](const std::string &name)
+                    { map[name] = &name; },
+                    [&map](const std::string &name)
+                    { return map.find(name) != map.end(); },
+                    [&map](const std::string &from, const std::string &to)
+                    {
+                        std::vector<const std::string *> matches;
+                        for (const auto &entry : map)
+                        {
+                            if (entry.first >= from && entry.first < to)
+                                matches.push_back(&entry.first);
+                        }
+                        std::sort(matches.begin(), matches.end(), [](const std::string *lhs, const std::string *rhs)
+                                  { return *lhs < *rhs; });
+                        return matches.size();
+                    });
+            }
+            releaseFreedMemory();
+            {
+                HashTable table;
+                measure(
+                    json, "IncrementalHashTable", names, sorted, std::min(scans_, kMapScans),
+                    [&table](const std::string &name)
+                    { table.insert(name, &name); },
+                    [&table](const std::string &name)
+                    { return table.find(name) != nullptr; },
+                    [&table](const std::string &from, const std::string &to)
+                    {
+                        std::vector<const std::string *> matches;
+                        for (auto entry = table.begin(); entry != table.end(); ++entry)
+                        {
+                            if (entry.name() >= from && entry.name() < to)
+                                matches.push_back(&entry.name());
+                        }
+                        std::sort(matches.begin(), matches.end(), [](const std::string *lhs, const std::string *rhs)
+                                  { return *lhs < *rhs; });
+                        return matches.size();
+                    });
+            }
+            releaseFreedMemory();
+            {
+                Index index;
+                measure(
+                    json, "ChildIndex", names, sorted, scans_,
+                    [&index](const std::string &name)
+                    { index.insert(name, &name); },
+                    [&index](const std::string &name)
+                    { return index.find(name) != nullptr; },
+                    [&index](const std::string &from, const std::string &to)
+                    {
+                        std::size_t visited = 0;
+                        index.scan(from, to, [&visited](const std::string &, const std::string *)
+                                   {
+                                       visited++;
+                                       return true; });
+                        return visited;
+                    });
+            }
+            releaseFreedMemory();
+            json.endArray().endObject();
+            out.flush();
+        }
+        out.put('\n');
+        json.endArray().endObject();
+        out.put('\n');
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-index`
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        IndexBenchmark benchmark;
+        try
+        {
+            benchmark.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing index options: " << e.what() << "\n"
+                      << "Usage: fm-index [--entries N,...] [--scans N] [--scan-length N] [--seed N]" << std::endl;
+            return 1;
+        }
+
+        FdOutputSink out{STDOUT_FILENO};
+        try
+        {
+            benchmark.run(out);
+        }
+        catch (const std::exception &e)
+        {
+            out.flush();
+            std::cerr << "Error while running index benchmark: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return IndexBenchmark::main(argc - 1, argv + 1);
+}
@@ -0,0 +1,411 @@
+/**
+ * @file replay.cpp
+ * @brief Open-loop load generator replaying recorded or synthetic operation traces, built as fm-replay
+ */
+
+#include "file_manager.hpp"
+#include "tool_options.hpp"
+
+#include <fstream>
+#include <optional>
+#include <random>
+
+/**
+ * @class TraceReplayer
+ * @brief Open-loop load generator, run with `fm-replay [options]`.
+ * Replays a recorded trace (see OperationRecorder) or a synthetic one with a given operation mix
+ * against a FileManager. Every operation has a scheduled start time that doesn't depend on
+ * how long earlier operations took, and latency is measured from that scheduled time,
+ * so a stall shows up in the latency of everything queued behind it.
+ */
+class TraceReplayer
+{
+private:
+    std::string tracePath_;
+    std::string recordPath_;
+    // where to serve the metrics while replaying and where to dump them afterwards, empty for nowhere
+    std::string metricsSocketPath_;
+    std::string metricsFilePath_;
+    std::size_t operations_{100000};
+    // operations per second, unset replays a recorded trace with its own timing
+    std::optional<double> rate_;
+    bool poissonArrivals_{false};
+    std::size_t contentSize_{256};
+    std::uint64_t seed_{1};
+    // createFile, updateFile, changeDirectory, deleteFile, createFolder, deleteFolder in Operation order
+    std::array<double, kOperationCount> mix_{};
+
+    std::vector<TraceEntry> entries_;
+
+    static constexpr double kDefaultRate = 10000;
+    // the generator gives up after this many picks in a row that the tree can't take
+    static constexpr std::size_t kMaxSkippedPicks = 100000;
+
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief default operation mix, roughly what an interactive file server sees:
+     * mostly reads of the tree and content updates, few structural changes
+     */
+    void setDefaultMix()
+    {
+        mix_[static_cast<std::size_t>(Operation::ChangeDirectory)] = 25;
+        mix_[static_cast<std::size_t>(Operation::CreateFolder)] = 3;
+        mix_[static_cast<std::size_t>(Operation::CreateFile)] = 25;
+        mix_[static_cast<std::size_t>(Operation::UpdateFile)] = 35;
+        mix_[static_cast<std::size_t>(Operation::DeleteFolder)] = 2;
+        mix_[static_cast<std::size_t>(Operation::DeleteFile)] = 10;
+    }
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        setDefaultMix();
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--trace")
+                tracePath_ = value;
+            else if (option == "--record")
+                recordPath_ = value;
+            else if (option == "--metrics-socket")
+                metricsSocketPath_ = value;
+            else if (option == "--metrics-file")
+                metricsFilePath_ = value;
+            else if (option == "--operations")
+                operations_ = std::stoull(value);
+            else if (option == "--rate")
+            {
+                rate_ = std::stod(value);
+                if (*rate_ <= 0)
+                    throw std::runtime_error("The rate has to be above 0");
+            }
+            else if (option == "--arrivals" && (value == "uniform" || value == "poisson"))
+                poissonArrivals_ = value == "poisson";
+            else if (option == "--content-size")
+                contentSize_ = std::stoull(value);
+            else if (option == "--seed")
+                seed_ = std::stoull(value);
+            else if (option == "--mix")
+                parseMix(value, mix_);
+            else
+                throw std::runtime_error("Unknown option " + std::string{option} + " " + value);
+        }
+        if (tracePath_.empty() == false)
+            return;
+        if (rate_.has_value() == false)
+            rate_ = kDefaultRate;
+        // only these grow the tree or move around it no matter what it looks like, without any of them
+        // updates and deletes would never find anything
+        auto weight = [this](Operation operation)
+        { return mix_[static_cast<std::size_t>(operation)]; };
+        if (weight(Operation::CreateFolder) + weight(Operation::CreateFile) + weight(Operation::ChangeDirectory) <= 0)
+            throw std::runtime_error("The mix needs some weight on createFolder, createFile or changeDirectory");
+    }
+
+    void loadTrace()
+    {
+        std::ifstream trace{tracePath_};
+        if (trace.is_open() == false)
+            throw std::runtime_error("Couldn't open trace " + tracePath_);
+        std::string line;
+        while (std::getline(trace, line))
+        {
+            if (line.empty() == false)
+                entries_.push_back(OperationRecorder::parseEntry(line));
+        }
+    }
+
+    /**
+     * @brief generates operations from the mix against a model of the tree it builds,
+     * so that most generated operations hit existing files and folders like real traffic does
+     * @throws std::runtime_error if the mix keeps picking operations the tree can't take
+     */
+    void generateTrace()
+    {
+        struct ModelFolder
+        {
+            std::vector<std::string> folders;
+            std::vector<std::string> files;
+        };
+        // keyed by path relative to the root, "" is the root
+        std::map<std::string, ModelFolder> model{{"", {}}};
+        std::string current;
+        std::size_t nextName = 0;
+
+        std::mt19937_64 random{seed_};
+        std::discrete_distribution<std::size_t> pickOperation{mix_.begin(), mix_.end()};
+        std::uniform_int_distribution<std::size_t> pickContentSize{0, 2 * contentSize_};
+        auto pickIndex = [&random](std::size_t size)
+        { return std::uniform_int_distribution<std::size_t>{0, size - 1}(random); };
+        auto childPath = [&current](const std::string &name)
+        { return current.empty() ? name : current + "/" + name; };
+
+        std::size_t skippedPicks = 0;
+        while (entries_.size() < operations_)
+        {
+            if (skippedPicks++ == kMaxSkippedPicks)
+                throw std::runtime_error("The operation mix picked " + std::to_string(kMaxSkippedPicks) +
+                                         " operations in a row that the generated tree can't take");
+            Operation operation = static_cast<Operation>(pickOperation(random));
+            ModelFolder &folder = model[current];
+            TraceEntry entry{0, operation, "", 0};
+            switch (operation)
+            {
+            case Operation::ChangeDirectory:
+            {
+                std::size_t choice = pickIndex(4);
+                if (choice == 0 && current.empty() == false)
+                {
+                    entry.argument = "..";
+                    entry.detail = 1;
+                    current.erase(current.find_last_of('/') == std::string::npos ? 0 : current.find_last_of('/'));
+                }
+                else if (choice == 1)
+                {
+                    // absolute jump to a random folder, found by a random walk down from the root
+                    current.clear();
+                    while (model[current].folders.empty() == false && pickIndex(3) != 0)
+                        current = childPath(model[current].folders[pickIndex(model[current].folders.size())]);
+                    entry.argument = current;
+                    entry.detail = 0;
+                }
+                else if (folder.folders.empty() == false)
+                {
+                    entry.argument = folder.folders[pickIndex(folder.folders.size())];
+                    entry.detail = 1;
+                    current = childPath(entry.argument);
+                }
+                else
+                    continue;
+                break;
+            }
+            case Operation::CreateFolder:
+                entry.argument = "d" + std::to_string(nextName++);
+                folder.folders.push_back(entry.argument);
+                model[childPath(entry.argument)];
+                break;
+            case Operation::CreateFile:
+                entry.argument = "f" + std::to_string(nextName++) + ".txt";
+                entry.detail = pickContentSize(random);
+                folder.files.push_back(entry.argument);
+                break;
+            case Operation::UpdateFile:
+                if (folder.files.empty())
+                    continue;
+                entry.argument = folder.files[pickIndex(folder.files.size())];
+                entry.detail = pickContentSize(random);
+                break;
+            case Operation::DeleteFile:
+            case Operation::DeleteFolder:
+            {
+                std::vector<std::string> &names = operation == Operation::DeleteFile ? folder.files : folder.folders;
+                if (names.empty())
+                    continue;
+                std::size_t index = pickIndex(names.size());
+                entry.argument = names[index];
+                names[index] = names.back();
+                names.pop_back();
+                if (operation == Operation::DeleteFolder)
+                {
+                    std::string path = childPath(entry.argument);
+                    model.erase(model.lower_bound(path), model.lower_bound(path + "0"));
+                }
+                break;
+            }
+            default:
+                continue;
+            }
+            entries_.push_back(std::move(entry));
+            skippedPicks = 0;
+        }
+    }
+
+    /**
+     * @brief assigns scheduled offsets to synthetic (or re-rated) entries
+     */
+    void scheduleEntries()
+    {
+        std::mt19937_64 random{seed_ + 1};
+        std::exponential_distribution<double> gap{*rate_};
+        double offsetSeconds = 0;
+        for (TraceEntry &entry : entries_)
+        {
+            entry.offsetMicros = static_cast<std::uint64_t>(offsetSeconds * 1e6);
+            offsetSeconds += poissonArrivals_ ? gap(random) : 1.0 / *rate_;
+        }
+    }
+
+    void run(OutputSink &out)
+    {
+        if (tracePath_.empty())
+            generateTrace();
+        else
+            loadTrace();
+        // recorded traces keep their own timing unless --rate asks for another
+        if (rate_.has_value())
+            scheduleEntries();
+        if (recordPath_.empty() == false)
+        {
+            std::ofstream record{recordPath_};
+            if (record.is_open() == false)
+                throw std::runtime_error("Couldn't open " + recordPath_ + " to record the trace");
+            {
+                OstreamOutputSink recordSink{record};
+                for (const TraceEntry &entry : entries_)
+                    OperationRecorder::writeEntry(recordSink, entry);
+            }
+            record.close();
+            if (record.fail())
+                throw std::runtime_error("Couldn't write the trace to " + recordPath_);
+        }
+
+        std::uint64_t maxContentSize = 0;
+        for (const TraceEntry &entry : entries_)
+        {
+            if (entry.operation == Operation::CreateFile || entry.operation == Operation::UpdateFile)
+                maxContentSize = std::max(maxContentSize, entry.detail);
+        }
+        std::string contentPool(maxContentSize, 'x');
+
+        std::array<std::unique_ptr<LatencyHistogram::Snapshot>, kOperationCount> latencies;
+        std::array<std::unique_ptr<LatencyHistogram::Snapshot>, kOperationCount> serviceTimes;
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            latencies[i] = std::make_unique<LatencyHistogram::Snapshot>();
+            serviceTimes[i] = std::make_unique<LatencyHistogram::Snapshot>();
+        }
+
+        std::unique_ptr<MetricsEndpoint> metricsEndpoint;
+        if (metricsSocketPath_.empty() == false)
+            metricsEndpoint = std::make_unique<MetricsEndpoint>(metricsSocketPath_);
+        // what the replayed operations print, their errors included, is thrown away
+        NullOutputSink quiet;
+        FileStorage storage{&quiet};
+        FileManager fileManager{&storage};
+        fileManager.setOutputSink(&quiet);
+        fileManager.setErrorSink(&quiet);
+        Clock::time_point begin = Clock::now();
+        for (const TraceEntry &entry : entries_)
+        {
+            Clock::time_point scheduled = begin + std::chrono::microseconds{entry.offsetMicros};
+            Clock::time_point now = Clock::now();
+            // sleep through long gaps, spin through the last stretch to start on time
+            if (scheduled - now > std::chrono::microseconds{200})
+                std::this_thread::sleep_for(scheduled - now - std::chrono::microseconds{100});
+            while (Clock::now() < scheduled)
+                ;
+
+            Clock::time_point start = Clock::now();
+            switch (entry.operation)
+            {
+            case Operation::ChangeDirectory:
+                fileManager.changeDirectory(entry.argument, entry.detail != 0);
+                break;
+            case Operation::CreateFolder:
+                fileManager.createFolder(entry.argument);
+                break;
+            case Operation::CreateFile:
+                fileManager.createFile(entry.argument, contentPool.substr(0, entry.detail));
+                break;
+            case Operation::UpdateFile:
+                fileManager.updateFile(entry.argument, contentPool.substr(0, entry.detail));
+                break;
+            case Operation::DeleteFolder:
+                fileManager.deleteFolder(entry.argument);
+                break;
+            case Operation::DeleteFile:
+                fileManager.deleteFile(entry.argument);
+                break;
+            default:
+                break;
+            }
+            Clock::time_point end = Clock::now();
+            std::size_t index = static_cast<std::size_t>(entry.operation);
+            latencies[index]->add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - scheduled).count());
+            serviceTimes[index]->add(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        double elapsedSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+        if (metricsFilePath_.empty() == false)
+            MetricsRegistry::instance().dumpPrometheus(metricsFilePath_);
+
+        JsonWriter json{out};
+        json.beginObject();
+        json.key("context").beginObject()
+            .field("trace", tracePath_.empty() ? "synthetic" : tracePath_)
+            .field("operations", entries_.size());
+        if (rate_.has_value())
+            json.field("targetRate", *rate_).field("arrivals", poissonArrivals_ ? "poisson" : "uniform");
+        else
+            json.field("timing", "recorded");
+        json.field("seed", seed_).endObject();
+        json.field("elapsedSeconds", elapsedSeconds)
+            .field("achievedRate", entries_.size() / elapsedSeconds);
+        json.key("results").beginArray();
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            out.put('\n');
+            json.beginObject().field("op", operationName(static_cast<Operation>(i)));
+            json.field("count", latencies[i]->totalCount);
+            for (const auto *histogram : {latencies[i].get(), serviceTimes[i].get()})
+            {
+                json.key(histogram == latencies[i].get() ? "latencyNs" : "serviceTimeNs").beginObject()
+                    .field("p50", histogram->valueAt(0.5))
+                    .field("p99", histogram->valueAt(0.99))
+                    .field("p999", histogram->valueAt(0.999))
+                    .field("max", histogram->max)
+                    .endObject();
+            }
+            json.endObject();
+        }
+        out.put('\n');
+        json.endArray().endObject();
+        out.put('\n');
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-replay`
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        TraceReplayer replayer;
+        try
+        {
+            replayer.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing replay options: " << e.what() << "\n"
+                      << "Usage: fm-replay [--trace FILE] [--rate OPS_PER_SECOND] [--arrivals uniform|poisson]"
+                      << " [--operations N] [--mix op=weight,...] [--content-size N] [--seed N] [--record FILE]"
+                      << " [--metrics-socket PATH] [--metrics-file PATH]" << std::endl;
+            return 1;
+        }
+
+        FdOutputSink out{STDOUT_FILENO};
+        try
+        {
+            replayer.run(out);
+        }
+        catch (const std::exception &e)
+        {
+            out.flush();
+            std::cerr << "Error while replaying: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return TraceReplayer::main(argc - 1, argv + 1);
+}
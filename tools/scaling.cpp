@@ -0,0 +1,467 @@
+/**
+ * @file scaling.cpp
+ * @brief Throughput of one shared storage on a growing number of threads, built as fm-scaling
+ */
+
+#include "file_manager.hpp"
+#include "tool_options.hpp"
+
+#include <random>
+
+/**
+ * @class ScalingBenchmark
+ * @brief Thread scaling harness, run with `fm-scaling [options]`.
+ * Every run gives each of N threads its own FileManager on one shared FileStorage and has them
+ * do a fixed number of operations from a mix, then reports throughput, scaling efficiency
+ * against the smallest thread count and how long each operation type waited for the storage lock.
+ * Sharing decides where the threads work: all in one folder (same-folder), each in its own
+ * folder (disjoint), or jumping between all the folders on every changeDirectory (random).
+ * Threads only create and delete names of their own and never enter folders that get deleted,
+ * so every operation that gets done succeeds and no FileManager is left in a deleted folder.
+ */
+class ScalingBenchmark
+{
+private:
+    enum class Sharing
+    {
+        SameFolder,
+        Disjoint,
+        Random
+    };
+
+    static constexpr const char *sharingName(Sharing sharing) noexcept
+    {
+        constexpr const char *names[] = {"same-folder", "disjoint", "random"};
+        return names[static_cast<std::size_t>(sharing)];
+    }
+
+    /**
+     * @brief names of one thread in one folder, split into the ones that currently exist
+     * and the ones that don't, so picking a name for any operation is O(1)
+     */
+    struct NamePool
+    {
+        std::vector<std::size_t> present;
+        std::vector<std::size_t> absent;
+
+        std::size_t take(std::vector<std::size_t> &from, std::vector<std::size_t> &to, std::size_t index)
+        {
+            std::size_t name = from[index];
+            from[index] = from.back();
+            from.pop_back();
+            to.push_back(name);
+            return name;
+        }
+    };
+
+    struct FolderPools
+    {
+        NamePool files;
+        NamePool folders;
+    };
+
+    struct Run
+    {
+        std::size_t threads;
+        Sharing sharing;
+        double seconds;
+        std::uint64_t operations;
+        std::array<std::uint64_t, kOperationCount> counts;
+    };
+
+    std::vector<std::size_t> threadCounts_;
+    std::vector<Sharing> sharings_{Sharing::SameFolder, Sharing::Disjoint, Sharing::Random};
+    std::size_t operations_{200000};
+    std::size_t names_{1000};
+    std::size_t contentSize_{256};
+    std::uint64_t seed_{1};
+    std::array<double, kOperationCount> mix_{};
+
+    // draws in a row a thread may throw away before the mix counts as stuck
+    static constexpr std::size_t kMaxSkippedPicks = 100000;
+
+    using Clock = std::chrono::steady_clock;
+
+    static std::string folderName(Sharing sharing, std::size_t index)
+    {
+        return sharing == Sharing::SameFolder ? "shared" : "t" + std::to_string(index);
+    }
+
+    static std::string nodeName(char kind, std::size_t thread, std::size_t name)
+    {
+        return kind + std::to_string(thread) + "_" + std::to_string(name);
+    }
+
+    /**
+     * @brief default mix: mostly lookups and content updates, some churn of files and folders
+     */
+    void setDefaultMix()
+    {
+        mix_[static_cast<std::size_t>(Operation::ChangeDirectory)] = 30;
+        mix_[static_cast<std::size_t>(Operation::CreateFolder)] = 5;
+        mix_[static_cast<std::size_t>(Operation::CreateFile)] = 15;
+        mix_[static_cast<std::size_t>(Operation::UpdateFile)] = 30;
+        mix_[static_cast<std::size_t>(Operation::DeleteFolder)] = 5;
+        mix_[static_cast<std::size_t>(Operation::DeleteFile)] = 15;
+    }
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        setDefaultMix();
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--threads")
+                threadCounts_ = parseSizes(value);
+            else if (option == "--sharing")
+                sharings_ = parseSharings(value);
+            else if (option == "--operations")
+                operations_ = std::stoull(value);
+            else if (option == "--names")
+                names_ = std::stoull(value);
+            else if (option == "--content-size")
+                contentSize_ = std::stoull(value);
+            else if (option == "--seed")
+                seed_ = std::stoull(value);
+            else if (option == "--mix")
+                parseMix(value, mix_);
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+        if (threadCounts_.empty())
+        {
+            // powers of two up to the hardware threads, and the hardware threads themselves
+            std::size_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+            for (std::size_t threads = 1; threads < hardwareThreads; threads *= 2)
+                threadCounts_.push_back(threads);
+            threadCounts_.push_back(hardwareThreads);
+        }
+        for (std::size_t threads : threadCounts_)
+        {
+            if (threads == 0)
+                throw std::runtime_error("Thread counts have to be at least 1");
+        }
+        if (names_ < 2)
+            throw std::runtime_error("Every thread needs at least 2 names per folder");
+        // only these can always be done, without any of them a thread runs out of names to update or delete
+        auto weight = [this](Operation operation)
+        { return mix_[static_cast<std::size_t>(operation)]; };
+        if (weight(Operation::CreateFolder) + weight(Operation::CreateFile) + weight(Operation::ChangeDirectory) <= 0)
+            throw std::runtime_error("The mix needs some weight on createFolder, createFile or changeDirectory");
+    }
+
+    static std::vector<Sharing> parseSharings(const std::string &list)
+    {
+        std::vector<Sharing> sharings;
+        std::size_t start = 0;
+        while (start <= list.size())
+        {
+            std::size_t end = list.find(',', start);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string_view item{list.data() + start, end - start};
+            bool known = false;
+            for (Sharing sharing : {Sharing::SameFolder, Sharing::Disjoint, Sharing::Random})
+            {
+                if (item == sharingName(sharing))
+                {
+                    sharings.push_back(sharing);
+                    known = true;
+                }
+            }
+            if (known == false)
+                throw std::runtime_error("Unknown sharing \"" + std::string{item} + "\"");
+            start = end + 1;
+        }
+        return sharings;
+    }
+
+    /**
+     * @brief creates the folders of a run and every thread's initial files and folders in them,
+     * half of each thread's names exist when the run starts
+     * @return the name pools of every thread, indexed by thread then by folder
+     */
+    std::vector<std::vector<FolderPools>> populate(FileStorage &storage, std::size_t threads, Sharing sharing)
+    {
+        std::size_t folders = sharing == Sharing::SameFolder ? 1 : threads;
+        NullOutputSink sink;
+        FileManager fileManager{&storage};
+        fileManager.setOutputSink(&sink);
+        fileManager.setErrorSink(&sink);
+        std::vector<std::string> folderNames;
+        for (std::size_t folder = 0; folder < folders; folder++)
+            folderNames.push_back(folderName(sharing, folder));
+        fileManager.createFolders(folderNames);
+
+        std::string content(contentSize_, 'x');
+        std::vector<std::vector<FolderPools>> pools(threads, std::vector<FolderPools>(folders));
+        for (std::size_t folder = 0; folder < folders; folder++)
+        {
+            fileManager.changeDirectory(folderNames[folder], false);
+            std::vector<std::pair<std::string, std::string>> newFiles;
+            std::vector<std::string> newFolders;
+            for (std::size_t thread = 0; thread < threads; thread++)
+            {
+                // disjoint threads never leave their own folder, so they only get names there
+                if (sharing == Sharing::Disjoint && thread != folder)
+                    continue;
+                FolderPools &pool = pools[thread][folder];
+                for (std::size_t name = 0; name < names_; name++)
+                {
+                    bool present = name % 2 == 0;
+                    (present ? pool.files.present : pool.files.absent).push_back(name);
+                    (present ? pool.folders.present : pool.folders.absent).push_back(name);
+                    if (present)
+                    {
+                        newFiles.emplace_back(nodeName('f', thread, name), content);
+                        newFolders.push_back(nodeName('d', thread, name));
+                    }
+                }
+            }
+            fileManager.createFiles(std::move(newFiles));
+            fileManager.createFolders(std::move(newFolders));
+        }
+        return pools;
+    }
+
+    /**
+     * @brief body of one worker thread, operations that can't happen
+     * (deleting with nothing left to delete and so on) are drawn again
+     * @throws std::runtime_error after kMaxSkippedPicks draws in a row that can't happen
+     */
+    void work(FileStorage &storage, std::size_t thread, std::size_t threads, Sharing sharing,
+              std::vector<FolderPools> &pools, const std::atomic<bool> &go,
+              std::array<std::uint64_t, kOperationCount> &counts) const
+    {
+        NullOutputSink sink;
+        FileManager fileManager{&storage};
+        fileManager.setOutputSink(&sink);
+        // operations are only done when they can succeed, nothing is expected on the error sink either
+        fileManager.setErrorSink(&sink);
+        std::mt19937_64 random{seed_ + thread};
+        std::discrete_distribution<std::size_t> pickOperation{mix_.begin(), mix_.end()};
+        auto pickIndex = [&random](std::size_t size)
+        { return std::uniform_int_distribution<std::size_t>{0, size - 1}(random); };
+        std::string content(contentSize_, 'y');
+
+        std::size_t folder = sharing == Sharing::Disjoint ? thread : 0;
+        fileManager.changeDirectory(folderName(sharing, folder), false);
+        while (go.load(std::memory_order_acquire) == false)
+            ;
+
+        std::size_t skippedPicks = 0;
+        for (std::size_t done = 0; done < operations_;)
+        {
+            if (skippedPicks++ == kMaxSkippedPicks)
+                throw std::runtime_error("The operation mix picked " + std::to_string(kMaxSkippedPicks) +
+                                         " operations in a row that thread " + std::to_string(thread) + " can't do");
+            Operation operation = static_cast<Operation>(pickOperation(random));
+            FolderPools &pool = pools[folder];
+            switch (operation)
+            {
+            case Operation::ChangeDirectory:
+                if (sharing == Sharing::Random)
+                    folder = pickIndex(threads);
+                fileManager.changeDirectory(folderName(sharing, folder), false);
+                break;
+            case Operation::CreateFolder:
+            case Operation::DeleteFolder:
+            case Operation::CreateFile:
+            case Operation::DeleteFile:
+            {
+                bool creates = operation == Operation::CreateFolder || operation == Operation::CreateFile;
+                bool isFile = operation == Operation::CreateFile || operation == Operation::DeleteFile;
+                NamePool &names = isFile ? pool.files : pool.folders;
+                std::vector<std::size_t> &from = creates ? names.absent : names.present;
+                std::vector<std::size_t> &to = creates ? names.present : names.absent;
+                if (from.empty())
+                    continue;
+                std::string name = nodeName(isFile ? 'f' : 'd', thread, names.take(from, to, pickIndex(from.size())));
+                if (operation == Operation::CreateFolder)
+                    fileManager.createFolder(name);
+                else if (operation == Operation::DeleteFolder)
+                    fileManager.deleteFolder(name);
+                else if (operation == Operation::CreateFile)
+                    fileManager.createFile(name, content);
+                else
+                    fileManager.deleteFile(name);
+                break;
+            }
+            case Operation::UpdateFile:
+                if (pool.files.present.empty())
+                    continue;
+                fileManager.updateFile(nodeName('f', thread, pool.files.present[pickIndex(pool.files.present.size())]), content);
+                break;
+            default:
+                continue;
+            }
+            counts[static_cast<std::size_t>(operation)]++;
+            done++;
+            skippedPicks = 0;
+        }
+    }
+
+    Run measure(std::size_t threads, Sharing sharing)
+    {
+        NullOutputSink quiet;
+        FileStorage storage{&quiet};
+        auto pools = populate(storage, threads, sharing);
+        std::vector<std::array<std::uint64_t, kOperationCount>> counts(threads);
+        MetricsRegistry::instance().resetLatencies();
+
+        std::atomic<bool> go{false};
+        std::vector<std::exception_ptr> failures(threads);
+        std::vector<std::thread> workers;
+        for (std::size_t thread = 0; thread < threads; thread++)
+        {
+            counts[thread].fill(0);
+            workers.emplace_back([&, thread]()
+                                 {
+                                     try
+                                     {
+                                         work(storage, thread, threads, sharing, pools[thread], go, counts[thread]);
+                                     }
+                                     catch (...)
+                                     {
+                                         failures[thread] = std::current_exception();
+                                     } });
+        }
+        // give the workers a moment to reach the starting line so they start together
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        Clock::time_point start = Clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread &worker : workers)
+            worker.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        for (const std::exception_ptr &failure : failures)
+        {
+            if (failure)
+                std::rethrow_exception(failure);
+        }
+
+        Run run{threads, sharing, seconds, 0, {}};
+        for (const auto &threadCounts : counts)
+        {
+            for (std::size_t i = 0; i < kOperationCount; i++)
+            {
+                run.counts[i] += threadCounts[i];
+                run.operations += threadCounts[i];
+            }
+        }
+        return run;
+    }
+
+    void writeRun(JsonWriter &json, const Run &run, double baselinePerThread)
+    {
+        double throughput = run.operations / run.seconds;
+        json.beginObject()
+            .field("sharing", sharingName(run.sharing))
+            .field("threads", run.threads)
+            .field("operations", run.operations)
+            .field("seconds", run.seconds)
+            .field("opsPerSecond", throughput)
+            .field("scalingEfficiency", throughput / run.threads / baselinePerThread);
+        json.key("operationsByType").beginArray();
+        for (std::size_t i = 0; i < kOperationCount; i++)
+        {
+            if (run.counts[i] == 0)
+                continue;
+            auto lockWait = MetricsRegistry::instance().lockWaitSnapshot(static_cast<Operation>(i));
+            auto latency = MetricsRegistry::instance().latencySnapshot(static_cast<Operation>(i));
+            json.beginObject()
+                .field("op", operationName(static_cast<Operation>(i)))
+                .field("count", run.counts[i]);
+            json.key("lockWaitNs").beginObject()
+                .field("mean", lockWait->totalCount == 0 ? 0.0 : static_cast<double>(lockWait->sum) / lockWait->totalCount)
+                .field("p50", lockWait->valueAt(0.5))
+                .field("p99", lockWait->valueAt(0.99))
+                .field("max", lockWait->max)
+                .field("total", lockWait->sum)
+                .endObject();
+            json.key("latencyNs").beginObject()
+                .field("p50", latency->valueAt(0.5))
+                .field("p99", latency->valueAt(0.99))
+                .endObject();
+            json.endObject();
+        }
+        json.endArray().endObject();
+    }
+
+    void run(OutputSink &out)
+    {
+        JsonWriter json{out};
+        json.beginObject();
+        json.key("context").beginObject()
+            .field("instrumentation", Instrumentation::enabled)
+            .field("hardwareThreads", std::thread::hardware_concurrency())
+            .field("operationsPerThread", operations_)
+            .field("namesPerThread", names_)
+            .field("contentSize", contentSize_)
+            .field("seed", seed_)
+            .endObject();
+        json.key("runs").beginArray();
+        for (Sharing sharing : sharings_)
+        {
+            // efficiency is throughput per thread relative to the first (smallest) thread count
+            double baselinePerThread = 0;
+            for (std::size_t threads : threadCounts_)
+            {
+                Run run = measure(threads, sharing);
+                if (baselinePerThread == 0)
+                    baselinePerThread = run.operations / run.seconds / run.threads;
+                out.put('\n');
+                writeRun(json, run, baselinePerThread);
+                out.flush();
+            }
+        }
+        out.put('\n');
+        json.endArray().endObject();
+        out.put('\n');
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-scaling`
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        ScalingBenchmark benchmark;
+        try
+        {
+            benchmark.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing scaling options: " << e.what() << "\n"
+                      << "Usage: fm-scaling [--threads N,...] [--sharing same-folder,disjoint,random]"
+                      << " [--operations N] [--names N] [--mix op=weight,...] [--content-size N] [--seed N]" << std::endl;
+            return 1;
+        }
+
+        FdOutputSink out{STDOUT_FILENO};
+        try
+        {
+            benchmark.run(out);
+        }
+        catch (const std::exception &e)
+        {
+            out.flush();
+            std::cerr << "Error while running scaling benchmark: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return ScalingBenchmark::main(argc - 1, argv + 1);
+}
@@ -0,0 +1,431 @@
+/**
+ * @file shape.cpp
+ * @brief Path resolution and listing cost across tree shapes, built as fm-shape
+ */
+
+#include "file_manager.hpp"
+#include "tool_options.hpp"
+
+#include <random>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @class PerfCounter
+ * @brief One hardware counter of the calling thread read through perf_event_open,
+ * stays unavailable where the kernel or the sandbox doesn't allow it
+ */
+class PerfCounter
+{
+private:
+    int fd_;
+
+public:
+    PerfCounter(std::uint32_t type, std::uint64_t config) noexcept
+    {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+    PerfCounter(const PerfCounter &) = delete;
+    PerfCounter &operator=(const PerfCounter &) = delete;
+
+    bool available() const noexcept
+    {
+        return fd_ >= 0;
+    }
+
+    void reset() noexcept
+    {
+        if (fd_ >= 0)
+            ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    }
+
+    void resume() noexcept
+    {
+        if (fd_ >= 0)
+            ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    void pause() noexcept
+    {
+        if (fd_ >= 0)
+            ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    /**
+     * @brief reads the events counted while resumed since the last reset()
+     */
+    std::uint64_t read() noexcept
+    {
+        if (fd_ < 0)
+            return 0;
+        std::uint64_t count = 0;
+        if (::read(fd_, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+
+    ~PerfCounter()
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+};
+
+/**
+ * @class ShapeBenchmark
+ * @brief Path resolution and listing cost across tree shapes, run with `fm-shape [options]`.
+ * Every fan-out gets a complete tree of about the same number of leaf folders, so small fan-outs
+ * make deep and narrow trees and large ones wide and shallow trees. The layout decides the order
+ * the folders are allocated in: depth-first keeps the folders of a path close together in memory,
+ * breadth-first keeps siblings together, random scatters both.
+ * Costs are reported in cycles per path component (or per listed entry), with cache misses
+ * per component next to them when hardware counters can be read.
+ */
+class ShapeBenchmark
+{
+private:
+    enum class Layout
+    {
+        DepthFirst,
+        BreadthFirst,
+        Random
+    };
+
+    static constexpr const char *layoutName(Layout layout) noexcept
+    {
+        constexpr const char *names[] = {"depth-first", "breadth-first", "random"};
+        return names[static_cast<std::size_t>(layout)];
+    }
+
+    struct Cost
+    {
+        double cycles;
+        double cacheMisses;
+        double l1dMisses;
+    };
+
+    std::vector<std::size_t> fanOuts_{2, 4, 16, 256};
+    std::vector<Layout> layouts_{Layout::DepthFirst, Layout::BreadthFirst, Layout::Random};
+    std::size_t leaves_{65536};
+    std::size_t lookups_{100000};
+    std::size_t repetitions_{5};
+    std::uint64_t seed_{1};
+
+    PerfCounter cacheMisses_{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES};
+    PerfCounter l1dMisses_{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+
+    /**
+     * @brief reads the time stamp counter where there is one, nanoseconds elsewhere
+     */
+    static std::uint64_t readCycles() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return steadyNanoseconds();
+#endif
+    }
+
+    static constexpr const char *cycleUnit() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return "tsc";
+#else
+        return "ns";
+#endif
+    }
+
+    static std::size_t depthFor(std::size_t fanOut, std::size_t leaves)
+    {
+        std::size_t depth = 1;
+        for (std::size_t count = fanOut; count < leaves; count *= fanOut)
+            depth++;
+        return depth;
+    }
+
+    static std::string childPath(const std::string &parent, std::size_t index)
+    {
+        return parent.empty() ? "n" + std::to_string(index) : parent + "/n" + std::to_string(index);
+    }
+
+    /**
+     * @brief creates a complete tree, one folder at a time in the order of the layout
+     * @return absolute paths (without the leading "/") of the deepest folders and of their parents
+     */
+    std::pair<std::vector<std::string>, std::vector<std::string>> build(FileManager &fileManager, std::size_t fanOut,
+                                                                        std::size_t depth, Layout layout)
+    {
+        struct Pending
+        {
+            std::string parent;
+            std::size_t index;
+            std::size_t level;
+        };
+        std::vector<std::string> leaves;
+        std::vector<std::string> parents;
+        std::deque<Pending> pending;
+        std::mt19937_64 random{seed_};
+        auto pushChildren = [&pending, fanOut, layout](const std::string &parent, std::size_t level)
+        {
+            // children go on the stack in reverse so the depth-first order visits the first child first
+            for (std::size_t i = fanOut; i-- > 0;)
+            {
+                if (layout == Layout::DepthFirst)
+                    pending.push_front({parent, i, level});
+                else
+                    pending.push_back({parent, fanOut - 1 - i, level});
+            }
+        };
+        pushChildren("", 1);
+
+        std::string current;
+        while (pending.empty() == false)
+        {
+            Pending next;
+            if (layout == Layout::Random)
+            {
+                std::size_t index = std::uniform_int_distribution<std::size_t>{0, pending.size() - 1}(random);
+                std::swap(pending[index], pending.back());
+                next = std::move(pending.back());
+                pending.pop_back();
+            }
+            else
+            {
+                next = std::move(pending.front());
+                pending.pop_front();
+            }
+            if (next.parent != current)
+            {
+                fileManager.changeDirectory(next.parent, false);
+                current = next.parent;
+            }
+            std::string path = childPath(next.parent, next.index);
+            fileManager.createFolder("n" + std::to_string(next.index));
+            if (next.level == depth)
+                leaves.push_back(std::move(path));
+            else
+            {
+                if (next.level + 1 == depth)
+                    parents.push_back(path);
+                pushChildren(path, next.level + 1);
+            }
+        }
+        if (depth == 1)
+            parents.push_back("");
+        return {std::move(leaves), std::move(parents)};
+    }
+
+    /**
+     * @brief runs prepare and then body once per target, repetitions times, only body is counted,
+     * and keeps the repetition with the fewest cycles
+     * @param units path components or entries the body handles over all the targets
+     */
+    template <typename Prepare, typename Body>
+    Cost measure(const std::vector<const std::string *> &targets, std::uint64_t units, Prepare &&prepare, Body &&body)
+    {
+        Cost best{std::numeric_limits<double>::max(), 0, 0};
+        for (std::size_t repetition = 0; repetition < repetitions_; repetition++)
+        {
+            cacheMisses_.reset();
+            l1dMisses_.reset();
+            std::uint64_t cycles = 0;
+            for (const std::string *target : targets)
+            {
+                prepare(*target);
+                cacheMisses_.resume();
+                l1dMisses_.resume();
+                std::uint64_t start = readCycles();
+                body(*target);
+                cycles += readCycles() - start;
+                l1dMisses_.pause();
+                cacheMisses_.pause();
+            }
+            if (static_cast<double>(cycles) / units < best.cycles)
+                best = {static_cast<double>(cycles) / units, static_cast<double>(cacheMisses_.read()) / units,
+                        static_cast<double>(l1dMisses_.read()) / units};
+        }
+        return best;
+    }
+
+    void writeCost(JsonWriter &json, std::string_view name, const Cost &cost)
+    {
+        json.key(name).beginObject().field("cycles", cost.cycles);
+        if (cacheMisses_.available())
+            json.field("cacheMisses", cost.cacheMisses);
+        if (l1dMisses_.available())
+            json.field("l1dReadMisses", cost.l1dMisses);
+        json.endObject();
+    }
+
+    /**
+     * @brief reads the command line options
+     * @throws std::runtime_error on unknown options or bad values
+     */
+    void parseOptions(int argc, char *argv[])
+    {
+        for (int i = 0; i < argc; i++)
+        {
+            std::string_view option{argv[i]};
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + std::string{option});
+            std::string value{argv[++i]};
+            if (option == "--fan-out")
+                fanOuts_ = parseSizes(value);
+            else if (option == "--layout")
+                layouts_ = parseLayouts(value);
+            else if (option == "--leaves")
+                leaves_ = std::stoull(value);
+            else if (option == "--lookups")
+                lookups_ = std::stoull(value);
+            else if (option == "--repetitions")
+                repetitions_ = std::stoull(value);
+            else if (option == "--seed")
+                seed_ = std::stoull(value);
+            else
+                throw std::runtime_error("Unknown option " + std::string{option});
+        }
+        for (std::size_t fanOut : fanOuts_)
+        {
+            if (fanOut < 2)
+                throw std::runtime_error("Fan-outs have to be at least 2");
+        }
+        if (leaves_ == 0 || lookups_ == 0 || repetitions_ == 0)
+            throw std::runtime_error("Leaves, lookups and repetitions have to be at least 1");
+    }
+
+    static std::vector<Layout> parseLayouts(const std::string &list)
+    {
+        std::vector<Layout> layouts;
+        std::size_t start = 0;
+        while (start <= list.size())
+        {
+            std::size_t end = list.find(',', start);
+            if (end == std::string::npos)
+                end = list.size();
+            std::string_view item{list.data() + start, end - start};
+            bool known = false;
+            for (Layout layout : {Layout::DepthFirst, Layout::BreadthFirst, Layout::Random})
+            {
+                if (item == layoutName(layout))
+                {
+                    layouts.push_back(layout);
+                    known = true;
+                }
+            }
+            if (known == false)
+                throw std::runtime_error("Unknown layout \"" + std::string{item} + "\"");
+            start = end + 1;
+        }
+        return layouts;
+    }
+
+    void run(OutputSink &out)
+    {
+        JsonWriter json{out};
+        json.beginObject();
+        json.key("context").beginObject()
+            .field("instrumentation", Instrumentation::enabled)
+            .field("cycleUnit", cycleUnit())
+            .field("cacheMissCounter", cacheMisses_.available())
+            .field("l1dMissCounter", l1dMisses_.available())
+            .field("leaves", leaves_)
+            .field("lookups", lookups_)
+            .field("repetitions", repetitions_)
+            .endObject();
+        json.key("shapes").beginArray();
+        for (std::size_t fanOut : fanOuts_)
+        {
+            std::size_t depth = depthFor(fanOut, leaves_);
+            for (Layout layout : layouts_)
+            {
+                NullOutputSink sink;
+                auto storage = std::make_unique<FileStorage>(&sink);
+                FileManager fileManager{storage.get()};
+                fileManager.setOutputSink(&sink);
+                fileManager.setErrorSink(&sink);
+                auto [leaves, parents] = build(fileManager, fanOut, depth, layout);
+
+                // the same random targets for every layout of a shape
+                std::mt19937_64 random{seed_};
+                std::vector<const std::string *> leafTargets;
+                std::vector<const std::string *> parentTargets;
+                std::uniform_int_distribution<std::size_t> pickLeaf{0, leaves.size() - 1};
+                std::uniform_int_distribution<std::size_t> pickParent{0, parents.size() - 1};
+                for (std::size_t i = 0; i < lookups_; i++)
+                {
+                    leafTargets.push_back(&leaves[pickLeaf(random)]);
+                    parentTargets.push_back(&parents[pickParent(random)]);
+                }
+
+                Cost resolve = measure(
+                    leafTargets, lookups_ * depth, [](const std::string &) {},
+                    [&fileManager](const std::string &path)
+                    { fileManager.changeDirectory(path, false); });
+                // listed folders hold their fan-out plus ".." unless they are the root
+                std::uint64_t entries = 0;
+                for (const std::string *path : parentTargets)
+                    entries += fanOut + (path->empty() ? 0 : 1);
+                Cost listing = measure(
+                    parentTargets, entries, [&fileManager](const std::string &path)
+                    { fileManager.changeDirectory(path, false); },
+                    [&fileManager](const std::string &)
+                    { fileManager.printCurrentFolderContents(); });
+
+                out.put('\n');
+                json.beginObject()
+                    .field("fanOut", fanOut)
+                    .field("depth", depth)
+                    .field("layout", layoutName(layout))
+                    .field("leaves", leaves.size());
+                writeCost(json, "changeDirectoryPerComponent", resolve);
+                writeCost(json, "listingPerEntry", listing);
+                json.endObject();
+                out.flush();
+            }
+        }
+        out.put('\n');
+        json.endArray().endObject();
+        out.put('\n');
+    }
+
+public:
+    /**
+     * @brief entry point of `fm-shape`
+     * @return process exit code
+     */
+    static int main(int argc, char *argv[])
+    {
+        ShapeBenchmark benchmark;
+        try
+        {
+            benchmark.parseOptions(argc, argv);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error while parsing shape options: " << e.what() << "\n"
+                      << "Usage: fm-shape [--fan-out N,...] [--layout depth-first,breadth-first,random]"
+                      << " [--leaves N] [--lookups N] [--repetitions N] [--seed N]" << std::endl;
+            return 1;
+        }
+
+        FdOutputSink out{STDOUT_FILENO};
+        benchmark.run(out);
+        return 0;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    return ShapeBenchmark::main(argc - 1, argv + 1);
+}
@@ -0,0 +1,64 @@
+/**
+ * @file tool_options.hpp
+ * @brief Command line option parsers shared by the tools
+ */
+
+#ifndef TOOL_OPTIONS_HPP
+#define TOOL_OPTIONS_HPP
+
+#include "file_manager.hpp"
+
+/**
+ * @brief parses a comma separated list of sizes
+ * @throws std::runtime_error if an item isn't a number
+ */
+inline std::vector<std::size_t> parseSizes(const std::string &list)
+{
+    std::vector<std::size_t> sizes;
+    std::size_t start = 0;
+    while (start <= list.size())
+    {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::size_t value = 0;
+        auto result = std::from_chars(list.data() + start, list.data() + end, value);
+        if (result.ec != std::errc{} || result.ptr != list.data() + end)
+            throw std::runtime_error("Expected a comma separated list of numbers, got \"" + list + "\"");
+        sizes.push_back(value);
+        start = end + 1;
+    }
+    return sizes;
+}
+
+/**
+ * @brief parses an operation mix given as op=weight pairs, operations left out get no weight
+ * @throws std::runtime_error on unknown operations or negative weights
+ */
+inline void parseMix(const std::string &list, std::array<double, kOperationCount> &mix)
+{
+    mix.fill(0);
+    std::size_t start = 0;
+    while (start < list.size())
+    {
+        std::size_t end = list.find(',', start);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string_view item{list.data() + start, end - start};
+        std::size_t equals = item.find('=');
+        bool known = false;
+        for (std::size_t i = 0; i < kOperationCount && equals != std::string_view::npos; i++)
+        {
+            if (item.substr(0, equals) == operationName(static_cast<Operation>(i)))
+            {
+                mix[i] = std::stod(std::string{item.substr(equals + 1)});
+                known = mix[i] >= 0;
+            }
+        }
+        if (known == false)
+            throw std::runtime_error("Expected operation=weight in mix, got \"" + std::string{item} + "\"");
+        start = end + 1;
+    }
+}
+
+#endif // TOOL_OPTIONS_HPP